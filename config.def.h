@@ -31,6 +31,13 @@ static const ColorPair color_normal    = { 33,  0,   NORM };
 static const ColorPair color_warn      = { 220, 0,   NORM };
 static const ColorPair color_err       = { 124, 0,   BOLD };
 
+/* drawing */
+static const int sync_output    = 1; /* frames as synchronized updates,
+                                        mode 2026, terminals without it
+                                        ignore it */
+static const int scroll_regions = 1; /* scroll a pane with margins where
+                                        the terminal has them */
+
 
 /* commands */
 #if defined(__linux__)
@@ -103,6 +110,10 @@ static Key nkeys[] = {
 	{ 'g',                 move_top,         { 0 }                    },
 	{ XK_SPACE,            switch_pane,      { 0 }                    },
 	{ '.',                 toggle_dotfiles,  { 0 }                    },
+	{ 'A',                 sort_by,          { .i = SortName }        },
+	{ 'S',                 sort_by,          { .i = SortSize }        },
+	{ 'M',                 sort_by,          { .i = SortTime }        },
+	{ 'E',                 sort_by,          { .i = SortExt }         },
 	{ XK_CTRL('r'),        refresh,          { 0 }                    },
 	{ XK_CTRL('f'),        create_new_file,  { 0 }                    },
 	{ XK_CTRL('m'),        create_new_dir,   { 0 }                    },
@@ -131,6 +142,51 @@ static const mode_t new_file_perm = S_IRUSR | S_IWUSR;
 /* dotfiles */
 static int show_dotfiles = 1;
 
+/* sorting, by file type first, a key pressed twice reverses */
+static int sort_mode = SortName; /* SortSize, SortTime, SortExt, plus
+                                    SortKeys to reverse */
+static const int name_order = NameBytes; /* NameNatural: file2 before
+                                            file10, NameLocale: by
+                                            LC_COLLATE */
+
+/* directory loading */
+static const int stat_threads      = 8;   /* stat workers, 1 is serial */
+static const int stat_parallel_min = 512; /* entries before batching */
+static const int sort_threads      = 8;   /* merge sort workers, 1 serial */
+static const int sort_parallel_min = 16384; /* entries before threads */
+static const int lazy_stat         = 0;   /* stat only visible entries */
+static const int use_io_uring      = 1;   /* linux: batch statx on a ring */
+static const int statx_dont_sync   = 0;   /* linux: trust cached attributes
+                                             on network mounts */
+static const int window_min        = 1000000; /* linux: bigger directories
+                                                 keep an unsorted window of
+                                                 entries, 0 never */
+static const int window_entries    = 8192;    /* entries in that window */
+static const int watch_window      = 50;  /* ms of filesystem events applied
+                                             together */
+static const int reload_delay      = 2000; /* ms between rereads of a
+                                              directory whose events
+                                              cannot be applied */
+
+/* slow mounts: lazy stat, one big batch, slower watcher updates */
+static const char *slow_fs[]       = { "nfs", "cifs", "smb", "fuse", "9p",
+                                       "ceph", "afs" }; /* type prefixes */
+static const size_t slow_fs_len    = LEN(slow_fs);
+static const int slow_stat_usec    = 2000; /* per entry, lazy above it */
+static const int slow_watch_delay  = 1000; /* watch_window on them */
+
+/* startup */
+static const int use_snapshot      = 1; /* show the last session's listings
+                                           until the real ones are checked */
+
+/* listing cache */
+static const int cache_size        = 16; /* directories kept, 0 disables */
+static const int prefetch_delay    = 300;  /* idle ms before loading the
+                                              cursor directory and the
+                                              parent, 0 never */
+static const int prefetch_max      = 4096; /* bigger ones are not
+                                              prefetched */
+
 /* statusbar */
 static const char dtfmt[] = "%F %R"; /* date time format */
 
@@ -0,0 +1,193 @@
+/* See LICENSE file for copyright and license details. */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdlib.h>
+
+#include "sfm.h"
+
+/* color pairs                            fg   bg   attr*/
+static const ColorPair color_blk       = { 95,  0,   NORM };
+static const ColorPair color_brlnk     = { 0,   9,   NORM };
+static const ColorPair color_chr       = { 94,  0,   NORM };
+static const ColorPair color_dir       = { 31,  0,   NORM };
+static const ColorPair color_exec      = { 91,  0,   NORM };
+static const ColorPair color_sock      = { 92,  0,   NORM };
+static const ColorPair color_ifo       = { 93,  0,   NORM };
+static const ColorPair color_lnk       = { 96,  0,   NORM };
+static const ColorPair color_other     = { 90,  0,   NORM };
+static const ColorPair color_file      = { 243, 0,   NORM };
+
+static const ColorPair color_frame     = { 237,  0,  NORM };
+static const ColorPair color_panell    = { 166, 233, BOLD };
+static const ColorPair color_panelr    = { 5,   233, BOLD };
+static const ColorPair color_status    = { 243, 0,   NORM };
+
+static const ColorPair color_search    = { 15, 104,   NORM };
+static const ColorPair color_selected  = { 21, 118,  NORM };
+
+static const ColorPair color_normal    = { 33,  0,   NORM };
+static const ColorPair color_warn      = { 220, 0,   NORM };
+static const ColorPair color_err       = { 124, 0,   BOLD };
+
+/* drawing */
+static const int sync_output    = 1; /* frames as synchronized updates,
+                                        mode 2026, terminals without it
+                                        ignore it */
+static const int scroll_regions = 1; /* scroll a pane with margins where
+                                        the terminal has them */
+
+
+/* commands */
+#if defined(__linux__)
+#define CHFLAG "chattr"
+#else
+#define CHFLAG "chflags"
+#endif
+static const char *rm_cmd[]      = { "rm", "-rf" }; /* delete */
+static const char *cp_cmd[]      = { "cp", "-r" }; /* copy */
+static const char *chown_cmd[]   = { "chown", "-R" }; /* change file owner and group */
+static const char *chmod_cmd[]   = { "chmod" }; /* change file mode bits */
+static const char *chflags_cmd[] = { CHFLAG }; /* change file flags */
+static const char *mv_cmd[]      = { "mv" }; /* move */
+static const char delconf[]      = "yes";
+
+static const size_t rm_cmd_len      = LEN(rm_cmd);
+static const size_t cp_cmd_len      = LEN(cp_cmd);
+static const size_t chown_cmd_len   = LEN(chown_cmd);
+static const size_t chmod_cmd_len   = LEN(chmod_cmd);
+static const size_t chflags_cmd_len = LEN(chflags_cmd);
+static const size_t mv_cmd_len      = LEN(mv_cmd);
+static const size_t delconf_len     = LEN(delconf);
+
+/* bookmarks */
+static const char root[]   = "/";
+
+/* software */
+static const char *mpv[]          = { "mpv", "--fullscreen" };
+static const char *sxiv[]         = { "sxiv" };
+static const char *mupdf[]        = { "mupdf", "-I" };
+static const char *libreoffice[]  = { "libreoffice" };
+static const char *gimp[]         = { "gimp" };
+static const char *r2[]           = { "r2", "-c", "vv" };
+
+/* extensions*/
+static const char *images[] = { "bmp", "jpg", "jpeg", "png", "gif", "webp", "xpm" };
+static const char *pdf[]    = { "epub", "pdf" };
+static const char *arts[]   = { "xcf" };
+static const char *obj[]    = { "o", "a", "so" };
+static const char *videos[] = { "avi", "flv", "wav", "webm", "wma", "wmv",
+                                "m2v", "m4a", "m4v", "mkv", "mov", "mp3",
+                                "mp4", "mpeg", "mpg" };
+static const char *docs[]   = { "odt", "doc", "docx", "xls", "xlsx", "odp",
+                                "ods", "pptx", "odg" };
+
+static Rule rules[] = {
+	RULE(videos, mpv,         DontWait),
+	RULE(images, sxiv,        DontWait),
+	RULE(pdf,    mupdf,       DontWait),
+	RULE(docs,   libreoffice, DontWait),
+	RULE(arts,   gimp,        DontWait),
+	RULE(obj,    r2,          Wait)
+};
+
+/* normal keys */
+static Key nkeys[] = {
+	/* key                 function          arg */
+	{ 'j',                 move_cursor,      { .i = +1 }              },
+	{ XK_DOWN,             move_cursor,      { .i = +1 }              },
+	{ 'k',                 move_cursor,      { .i = -1 }              },
+	{ XK_UP,               move_cursor,      { .i = -1 }              },
+	{ XK_CTRL('u'),        move_cursor,      { .i = -5 }              },
+	{ XK_CTRL('d'),        move_cursor,      { .i = +5 }              },
+	{ '{',                 move_cursor,      { .i = -10 }             },
+	{ '}',                 move_cursor,      { .i = +10 }             },
+	{ 'l',                 open_entry,       { 0 }                    },
+	{ 'h',                 cd_to_parent,     { 0 }                    },
+	{ 'q',                 quit,             { 0 }                    },
+	{ 'G',                 move_bottom,      { 0 }                    },
+	{ 'g',                 move_top,         { 0 }                    },
+	{ XK_SPACE,            switch_pane,      { 0 }                    },
+	{ '.',                 toggle_dotfiles,  { 0 }                    },
+	{ 'A',                 sort_by,          { .i = SortName }        },
+	{ 'S',                 sort_by,          { .i = SortSize }        },
+	{ 'M',                 sort_by,          { .i = SortTime }        },
+	{ 'E',                 sort_by,          { .i = SortExt }         },
+	{ XK_CTRL('r'),        refresh,          { 0 }                    },
+	{ XK_CTRL('f'),        create_new_file,  { 0 }                    },
+	{ XK_CTRL('m'),        create_new_dir,   { 0 }                    },
+	{ 'd',                 delete_entry,     { 0 }                    },
+	{ 'y',                 copy_entries,     { 0 }                    },
+	{ 'p',                 paste_entries,    { 0 }                    },
+	{ 'P',                 move_entries,     { 0 }                    },
+	{ 'v',                 visual_mode,      { 0 }                    },
+	{ XK_ESC,              normal_mode,      { 0 }                    },
+	{ 's',                 select_cur_entry, { .i = InvertSelection } },
+	{ 'x',                 select_all,       { .i = DontSelect }      },
+	{ 'a',                 select_all,       { .i = Select }          },
+	{ 'i',                 select_all,       { .i = InvertSelection } },
+	{ '/',                 start_search,     { 0 }                    },
+	{ 'n',                 move_to_match,    { .i = NextMatch }       },
+	{ 'N',                 move_to_match,    { .i = PrevMatch }       },
+};
+
+static const size_t nkeyslen = LEN(nkeys);
+//static const size_t ckeyslen = LEN(ckeys);
+
+/* permissions */
+static const mode_t new_dir_perm  = S_IRWXU;
+static const mode_t new_file_perm = S_IRUSR | S_IWUSR;
+
+/* dotfiles */
+static int show_dotfiles = 1;
+
+/* sorting, by file type first, a key pressed twice reverses */
+static int sort_mode = SortName; /* SortSize, SortTime, SortExt, plus
+                                    SortKeys to reverse */
+static const int name_order = NameBytes; /* NameNatural: file2 before
+                                            file10, NameLocale: by
+                                            LC_COLLATE */
+
+/* directory loading */
+static const int stat_threads      = 8;   /* stat workers, 1 is serial */
+static const int stat_parallel_min = 512; /* entries before batching */
+static const int sort_threads      = 8;   /* merge sort workers, 1 serial */
+static const int sort_parallel_min = 16384; /* entries before threads */
+static const int lazy_stat         = 0;   /* stat only visible entries */
+static const int use_io_uring      = 1;   /* linux: batch statx on a ring */
+static const int statx_dont_sync   = 0;   /* linux: trust cached attributes
+                                             on network mounts */
+static const int window_min        = 1000000; /* linux: bigger directories
+                                                 keep an unsorted window of
+                                                 entries, 0 never */
+static const int window_entries    = 8192;    /* entries in that window */
+static const int watch_window      = 50;  /* ms of filesystem events applied
+                                             together */
+static const int reload_delay      = 2000; /* ms between rereads of a
+                                              directory whose events
+                                              cannot be applied */
+
+/* slow mounts: lazy stat, one big batch, slower watcher updates */
+static const char *slow_fs[]       = { "nfs", "cifs", "smb", "fuse", "9p",
+                                       "ceph", "afs" }; /* type prefixes */
+static const size_t slow_fs_len    = LEN(slow_fs);
+static const int slow_stat_usec    = 2000; /* per entry, lazy above it */
+static const int slow_watch_delay  = 1000; /* watch_window on them */
+
+/* startup */
+static const int use_snapshot      = 1; /* show the last session's listings
+                                           until the real ones are checked */
+
+/* listing cache */
+static const int cache_size        = 16; /* directories kept, 0 disables */
+static const int prefetch_delay    = 300;  /* idle ms before loading the
+                                              cursor directory and the
+                                              parent, 0 never */
+static const int prefetch_max      = 4096; /* bigger ones are not
+                                              prefetched */
+
+/* statusbar */
+static const char dtfmt[] = "%F %R"; /* date time format */
+
+#endif // CONFIG_H
@@ -2,46 +2,74 @@
 
 #if defined(__linux__)
 	#define _GNU_SOURCE
+	#include <sys/epoll.h>
 	#include <sys/inotify.h>
+	#include <sys/syscall.h>
 	#include <sys/types.h>
-	#define EV_BUF_LEN (1024 * (sizeof(struct inotify_event) + 16))
+	#include <sys/vfs.h>
+	#if defined(__has_include)
+		#if __has_include(<linux/io_uring.h>)
+			#include <linux/io_uring.h>
+		#endif
+	#endif
+	/* IORING_OP_STATX came with IORING_FEAT_RW_CUR_POS in 5.6 */
+	#if defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup)
+		#define HAVE_IO_URING
+	#endif
+	#define EV_BUF_LEN    (1024 * (sizeof(struct inotify_event) + 16))
+	#define DENTS_BUF_LEN (32 * 1024)
 	#define OFF_T      "%ld"
 	#define M_TIME     st_mtim
+	#define C_TIME     st_ctim
 
 #elif defined(__APPLE__)
 	#define _DARWIN_C_SOURCE
 	#include <sys/types.h>
 	#include <sys/time.h>
 	#include <sys/event.h>
+	#include <sys/param.h>
+	#include <sys/mount.h>
 
 	#include <fcntl.h>
 	#include <limits.h>
 	#define OFF_T  "%lld"
 	#define M_TIME st_mtimespec
+	#define C_TIME st_ctimespec
 
 #elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
 	#define __BSD_VISIBLE 1
 	#include <sys/types.h>
 	#include <sys/time.h>
 	#include <sys/event.h>
+	#if defined(__NetBSD__)
+		#include <sys/statvfs.h>
+	#else
+		#include <sys/param.h>
+		#include <sys/mount.h>
+	#endif
 
 	#include <fcntl.h>
 	#include <limits.h>
 	#define OFF_T  "%ld"
 	#define M_TIME st_mtim
+	#define C_TIME st_ctim
 
 #elif defined(__OpenBSD__)
 	#include <sys/types.h>
 	#include <sys/time.h>
 	#include <sys/event.h>
+	#include <sys/param.h>
+	#include <sys/mount.h>
 
 	#include <fcntl.h>
 	#define OFF_T  "%lld"
 	#define M_TIME st_mtim
+	#define C_TIME st_ctim
 
 #endif
 
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 
@@ -50,6 +78,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <grp.h>
+#include <locale.h>
+#include <poll.h>
 #include <pthread.h>
 #include <pwd.h>
 #include <signal.h>
@@ -60,19 +90,49 @@
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
+#include <wchar.h>
 
 #include "sfm.h"
 #include "config.h"
 
 /* global variables */
 static Terminal term;
+static const Cell blank_cell = { " ", 1, 1, 1, { 0, 0, 0 } };
+static Line *lines; /* entry rows as drawn, for both panes */
+static Cell *line_cells;
+static int lines_len;
+static int lines_width;
+static int line_clock; /* next slot to claim */
 static Pane *current_pane;
 static Pane panes[2];
+static Watcher watcher; /* one thread for both panes */
 static int pane_idx;
 char *editor[2] = { "vi", NULL };
 char *shell[2] = { "/bin/sh", NULL };
 char *home = "/";
-static pid_t fork_pid, main_pid;
+static pid_t fork_pid;
+static int load_pipe[2];
+static Listing *cache; /* recently left directories */
+static unsigned long cache_tick;
+static int cache_fd = -1; /* inotify watches of the cached listings */
+static Loader *prefetch;  /* fills the cache while the user is idle */
+static struct timespec start_time;
+static long first_frame_usec;
+static long listings_usec = -1; /* until both panes are loaded */
+static int report_startup;      /* -t, printed on exit */
+static int signal_pipe[2]; /* all a signal handler does is write here */
+static int resize_pending;
+static struct timespec resize_time; /* of the last SIGWINCH */
+static struct timespec idle_since;  /* of the last event */
+static int redraw_pending; /* drawn once everything ready is handled */
+static int redraw_errno;
+static int prefetch_step; /* next of cursor directory, parent, none */
+#if defined(HAVE_IO_URING)
+static pthread_once_t uring_once = PTHREAD_ONCE_INIT;
+static pthread_key_t uring_key; /* the ring of a loader thread */
+static int uring_broken;        /* setup failed, never tried again */
+#endif
+static const char *sort_names[] = { "name", "size", "time", "extension" };
 static char **selected_entries = NULL;
 static int selected_count = 0;
 static int mode;
@@ -105,6 +165,7 @@ init_term(void)
 	term.buffer = ecalloc(term.buffer_size, sizeof(char));
 	term.buffer_left = term.buffer_size;
 	term.buffer_index = 0;
+	resize_cells();
 }
 
 static void
@@ -119,6 +180,11 @@ enable_raw_mode(void)
 	tcsetattr(STDIN_FILENO, TCSAFLUSH, &term.newterm);
 	if (write(STDOUT_FILENO, "\x1b[?1049h", 8) < 0)
 		die("write:");
+
+	/* the answer tells whether a pane can scroll on its own */
+	term.margins = 0;
+	if (scroll_regions && write(STDOUT_FILENO, "\x1b[?69$p", 7) < 0)
+		die("write:");
 }
 
 static void
@@ -154,46 +220,96 @@ static int
 start_signal(void)
 {
 	struct sigaction sa;
-	main_pid = getpid();
+	int i;
+
+	if (pipe(signal_pipe) < 0)
+		die("pipe:");
+	for (i = 0; i < 2; i++) {
+		fcntl(signal_pipe[i], F_SETFL, O_NONBLOCK);
+		fcntl(signal_pipe[i], F_SETFD, FD_CLOEXEC);
+	}
 	sa.sa_handler = sighandler;
 	sigemptyset(&sa.sa_mask);
 	sa.sa_flags = SA_RESTART;
-	sigaction(SIGUSR1, &sa, 0);
-	sigaction(SIGUSR2, &sa, 0);
 	sigaction(SIGWINCH, &sa, 0);
 	return 0;
 }
 
+static void
+block_signals(sigset_t *oldset)
+{
+	sigset_t set;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGWINCH);
+	pthread_sigmask(SIG_BLOCK, &set, oldset);
+}
+
 static void
 sighandler(int signo)
 {
-	if (fork_pid > 0) /* while forking ignore signals */
-		return;
+	int saved_errno = errno;
+	char c = (char)signo;
 
-	switch (signo) {
-	case SIGWINCH:
-		log_to_file(__func__, __LINE__, "SIGWINCH");
-		termb_resize();
-		break;
-	case SIGUSR1:
-		log_to_file(__func__, __LINE__, "SIGUSR1");
-		set_pane_entries(&panes[Left]);
-		update_screen();
-		break;
-	case SIGUSR2:
-		log_to_file(__func__, __LINE__, "SIGUSR2");
-		set_pane_entries(&panes[Right]);
-		update_screen();
-		break;
-	default:
-		break;
+	/* the main loop does the work, a full pipe has it queued already */
+	write(signal_pipe[1], &c, 1);
+	errno = saved_errno;
+}
+
+static void
+handle_signals(void)
+{
+	char buf[64];
+	ssize_t n, i;
+
+	while ((n = read(signal_pipe[0], buf, sizeof(buf))) > 0) {
+		for (i = 0; i < n; i++) {
+			if (buf[i] != SIGWINCH)
+				continue;
+			/* a dragged window sends many, only the last counts */
+			resize_pending = 1;
+			clock_gettime(CLOCK_MONOTONIC, &resize_time);
+		}
 	}
+	errno = 0;
+}
+
+static void
+schedule_redraw(void)
+{
+	/* update_screen shows errno, keep it until the frame */
+	if (errno != 0)
+		redraw_errno = errno;
+	redraw_pending = 1;
+}
+
+static int
+prefetch_wait(void)
+{
+	/* nothing happened for a while, look ahead */
+	if (prefetch_delay <= 0 || prefetch != NULL || prefetch_step >= 2)
+		return -1;
+	return time_left(&idle_since, prefetch_delay);
+}
+
+static int
+time_left(const struct timespec *start, int total)
+{
+	struct timespec now;
+	long ms;
+
+	/* of total ms since start, for a poll timeout */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (now.tv_sec - start->tv_sec) * 1000 +
+		(now.tv_nsec - start->tv_nsec) / 1000000;
+	return ms >= total ? 0 : (int)(total - ms);
 }
 
 static void
 set_panes(void)
 {
 	char cwd[PATH_MAX];
+	int i;
 
 	if ((getcwd(cwd, sizeof(cwd)) == NULL))
 		strncpy(cwd, home, PATH_MAX - 1);
@@ -203,8 +319,9 @@ set_panes(void)
 	panes[Left].entry_count = 0;
 	panes[Left].start_index = 0;
 	panes[Left].current_index = 0;
-	panes[Left].watcher.fd = -1;
-	panes[Left].watcher.signal = SIGUSR1;
+	panes[Left].dirfd = -1;
+	panes[Left].loader = NULL;
+	panes[Left].partial = 1;
 	panes[Left].offset = 0;
 
 	strncpy(panes[Right].path, home, PATH_MAX - 1);
@@ -212,141 +329,2602 @@ set_panes(void)
 	panes[Right].entry_count = 0;
 	panes[Right].start_index = 0;
 	panes[Right].current_index = 0;
-	panes[Right].watcher.fd = -1;
-	panes[Right].watcher.signal = SIGUSR2;
+	panes[Right].dirfd = -1;
+	panes[Right].loader = NULL;
+	panes[Right].partial = 1;
 	panes[Right].offset = term.cols / 2;
 
 	pane_idx = Left; /* cursor pane */
 	current_pane = &panes[pane_idx];
 
-	set_pane_entries(&panes[Left]);
-	set_pane_entries(&panes[Right]);
+	if (pipe(load_pipe) < 0)
+		die("pipe:");
+	for (i = 0; i < 2; i++) {
+		fcntl(load_pipe[i], F_SETFL, O_NONBLOCK);
+		fcntl(load_pipe[i], F_SETFD, FD_CLOEXEC);
+	}
+	cache = ecalloc(MAX(cache_size, 1), sizeof(Listing));
+#if defined(__linux__)
+	if (cache_size > 0)
+		cache_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+	load_snapshot();
+	set_pane_entries(&panes[Left], panes[Left].path);
+	set_pane_entries(&panes[Right], panes[Right].path);
 }
 
 static void
-set_pane_entries(Pane *pane)
+set_pane_entries(Pane *pane, const char *path)
 {
-	int fd, i;
-	DIR *dir;
-	char tmpfull[PATH_MAX];
-	const struct dirent *entry;
-	struct stat status;
+	Loader *ld;
+	Listing *hit;
+	sigset_t oldset;
+	int err;
+
+	/* path may be the old loader's, copy it before the cancel */
+	ld = new_loader(pane, path);
+	stop_loader(pane);
+	pane->reload = ReloadNone; /* this load reads any change */
+
+	/* a snapshot listing stays if the directory has not changed */
+	if (pane->validate && strncmp(ld->path, pane->path, PATH_MAX) == 0) {
+		ld->validate = 1;
+		ld->expect = pane->stamp;
+	}
+	pane->validate = 0;
+
+	/* a reload of the shown directory always reads it again */
+	if (strncmp(ld->path, pane->path, PATH_MAX) != 0 &&
+		(hit = cache_lookup(ld->path)) != NULL) {
+		cache_restore(pane, hit);
+		free_loader(ld);
+		return;
+	}
+
+	/* the thread inherits the blocked signals */
+	block_signals(&oldset);
+	err = pthread_create(&ld->thread, NULL, load_worker, ld);
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+	if (err != 0) {
+		print_status(color_err, strerror(err));
+		free_loader(ld);
+		return;
+	}
+	/* the pane keeps its listing until the new one has entries */
+	pane->loader = ld;
+}
+
+static Loader *
+new_loader(Pane *pane, const char *path)
+{
+	Loader *ld;
+
+	ld = ecalloc(1, sizeof(Loader));
+	strncpy(ld->path, path, PATH_MAX - 1);
+	ld->pane = pane;
+	ld->dirfd = -1;
+	ld->window.stride = WINDOW_STRIDE;
+	ld->window.dotfiles = show_dotfiles;
+	ld->batch_target = MAX(term.rows - 2, 1); /* first screenful */
+	pthread_mutex_init(&ld->lock, NULL);
+	return ld;
+}
+
+static const char *
+target_path(Pane *pane)
+{
+	/* where the pane is going, not what it still shows */
+	return pane->loader != NULL ? pane->loader->path : pane->path;
+}
+
+static void
+stop_loader(Pane *pane)
+{
+	Loader *ld = pane->loader;
+
+	pane->loader = NULL;
+	cancel_loader(ld);
+}
+
+static void
+cancel_loader(Loader *ld)
+{
+	int done;
+
+	if (ld == NULL)
+		return;
+
+	/*
+	 * never wait on a loader that may hang in open or getdents, one
+	 * still running is detached under the lock, before finish_load
+	 * can see cancel and free it
+	 */
+	pthread_mutex_lock(&ld->lock);
+	done = ld->done;
+	ld->cancel = 1;
+	if (!done)
+		pthread_detach(ld->thread);
+	pthread_mutex_unlock(&ld->lock);
+
+	if (done) {
+		pthread_join(ld->thread, NULL);
+		free_loader(ld);
+	}
+}
+
+static void
+free_loader(Loader *ld)
+{
+	if (ld->dirfd >= 0)
+		close(ld->dirfd);
+	arena_free(&ld->names);
+	arena_free(&ld->pending_names);
+	free(ld->window.offsets);
+	free(ld->pending);
+	free(ld->pending_order);
+	free(ld->batch);
+	free(ld->batch_order);
+	pthread_mutex_destroy(&ld->lock);
+	free(ld);
+}
+
+static void
+start_prefetch(void)
+{
+	Pane *pane = current_pane;
+	Entry *ent;
+	Loader *ld;
+	char path[PATH_MAX];
+	char *slash;
+	sigset_t oldset;
+
+	/* the pane's own load and slow mounts come first */
+	if (prefetch != NULL || pane->loader != NULL || pane->slow ||
+		pane->window.offsets != NULL)
+		return;
+
+	while (prefetch_step < 2) {
+		path[0] = '\0';
+		if (prefetch_step++ == 0) {
+			/* the directory under the cursor, for open_entry */
+			if (pane->current_index >= pane->view_count)
+				continue;
+			ent = pane_entry(pane, pane->current_index);
+			if (!S_ISDIR(ent->mode))
+				continue;
+			get_fullpath(path, pane->path, ent->name);
+		} else {
+			/* and the parent, for cd_to_parent */
+			strncpy(path, pane->path, PATH_MAX - 1);
+			path[PATH_MAX - 1] = '\0';
+			slash = strrchr(path, '/');
+			if (slash == NULL || path[1] == '\0')
+				continue;
+			slash[slash == path] = '\0';
+		}
+		if (cache_lookup(path) != NULL)
+			continue;
+
+		ld = new_loader(NULL, path);
+		ld->prefetch = 1;
+		ld->batch_target = LOAD_BATCH_MAX;
+		block_signals(&oldset);
+		if (pthread_create(&ld->thread, NULL, load_worker, ld) == 0)
+			prefetch = ld;
+		else
+			free_loader(ld);
+		pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+		return;
+	}
+}
+
+static void
+stop_prefetch(void)
+{
+	cancel_loader(prefetch);
+	prefetch = NULL;
+	prefetch_step = 0;
+}
+
+static void
+merge_prefetch(void)
+{
+	Loader *ld = prefetch;
+	Pane tmp;
+	int done;
+
+	if (ld == NULL)
+		return;
+	pthread_mutex_lock(&ld->lock);
+	done = ld->done;
+	pthread_mutex_unlock(&ld->lock);
+	if (done == 0)
+		return;
+
+	pthread_join(ld->thread, NULL);
+	prefetch = NULL;
+	if (ld->error == 0) {
+		/* a pane that was never shown, all of it goes to the cache */
+		memset(&tmp, 0, sizeof(Pane));
+		strncpy(tmp.path, ld->path, PATH_MAX - 1);
+		tmp.entries = ld->pending;
+		tmp.orders[SortName] = ld->pending_order;
+		tmp.entry_count = ld->pending_count;
+		arena_move(&tmp.names, &ld->pending_names);
+		tmp.dirfd = ld->dirfd;
+		tmp.stamp = ld->stamp;
+		tmp.slow = ld->slow;
+		memcpy(tmp.fstype, ld->fstype, FSTYPE_MAX);
+		ld->pending = NULL;
+		ld->pending_order = NULL;
+		ld->dirfd = -1;
+		cache_store(&tmp);
+		free_entries(&tmp);
+	}
+	free_loader(ld);
+}
+
+static int
+load_cancelled(Loader *ld)
+{
+	int cancel;
+
+	pthread_mutex_lock(&ld->lock);
+	cancel = ld->cancel;
+	pthread_mutex_unlock(&ld->lock);
+	return cancel;
+}
+
+static void *
+load_worker(void *arg)
+{
+	Loader *ld = (Loader *)arg;
+	char fstype[FSTYPE_MAX];
+	struct stat st;
+	int fd, err;
+
+	fd = open(ld->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		finish_load(ld, errno);
+		return NULL;
+	}
+	/* taken before reading, a change while reading makes it stale */
+	if (fstat(fd, &st) < 0)
+		memset(&st, 0, sizeof(st));
+
+	/* network and fuse mounts start lazy, before the first stat */
+	get_fs_type(fd, fstype, sizeof(fstype));
+
+	/* kept for lazy stat, the pane gets its own copy */
+	pthread_mutex_lock(&ld->lock);
+	ld->dirfd = fd;
+	memcpy(ld->fstype, fstype, sizeof(fstype));
+	ld->slow = is_slow_fs(fstype);
+	set_stamp(&ld->stamp, &st);
+	ld->unchanged = ld->validate && same_stamp(&ld->stamp, &ld->expect);
+	pthread_mutex_unlock(&ld->lock);
+	if (ld->unchanged) {
+		finish_load(ld, 0);
+		return NULL;
+	}
+	if (ld->slow && ld->prefetch) {
+		finish_load(ld, EAGAIN); /* not worth a slow mount */
+		return NULL;
+	}
+	if (ld->slow)
+		ld->batch_target = LOAD_BATCH_MAX;
+
+	err = read_entries(ld, fd) < 0 ? errno : 0;
+	flush_batch(ld, fd);
+	finish_load(ld, err);
+	return NULL;
+}
+
+#if defined(__linux__)
+static void
+get_fs_type(int fd, char *buf, size_t len)
+{
+	static const FsMagic types[] = {
+		{ 0x0000EF53, "ext4" },  { 0x9123683E, "btrfs" },
+		{ 0x58465342, "xfs" },   { 0x2FC12FC1, "zfs" },
+		{ 0x01021994, "tmpfs" }, { 0x794C7630, "overlay" },
+		{ 0x00006969, "nfs" },   { 0x0000517B, "smb" },
+		{ 0xFF534D42, "cifs" },  { 0xFE534D42, "smb2" },
+		{ 0x65735546, "fuse" },  { 0x01021997, "9p" },
+		{ 0x00C36400, "ceph" },  { 0x5346414F, "afs" },
+	};
+	struct statfs sfs;
+	size_t i;
+
+	snprintf(buf, len, "?");
+	if (fstatfs(fd, &sfs) < 0)
+		return;
+	for (i = 0; i < LEN(types); i++) {
+		if ((uint32_t)sfs.f_type == types[i].magic) {
+			snprintf(buf, len, "%s", types[i].name);
+			return;
+		}
+	}
+	snprintf(buf, len, "%lx", (unsigned long)sfs.f_type);
+}
+#else
+static void
+get_fs_type(int fd, char *buf, size_t len)
+{
+#if defined(__NetBSD__)
+	struct statvfs sfs;
+
+	if (fstatvfs(fd, &sfs) < 0) {
+#else
+	struct statfs sfs;
+
+	if (fstatfs(fd, &sfs) < 0) {
+#endif
+		snprintf(buf, len, "?");
+		return;
+	}
+	snprintf(buf, len, "%s", sfs.f_fstypename);
+}
+#endif
+
+static int
+is_slow_fs(const char *fstype)
+{
+	size_t i;
+
+	for (i = 0; i < slow_fs_len; i++) {
+		if (strncmp(fstype, slow_fs[i], strlen(slow_fs[i])) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+static void
+finish_load(Loader *ld, int err)
+{
+	int cancel;
+
+	pthread_mutex_lock(&ld->lock);
+	if (ld->windowed)
+		ld->counted = ld->window.total;
+	ld->error = err;
+	ld->done = 1;
+	cancel = ld->cancel;
+	pthread_mutex_unlock(&ld->lock);
+
+	/* a cancelled loader was detached, nobody else will free it */
+	if (cancel)
+		free_loader(ld);
+	else
+		notify_loaded(ld);
+}
+
+static void
+notify_loaded(Loader *ld)
+{
+	char c = ld->pane != NULL ? (char)(ld->pane - panes) : 2;
+
+	/* a full pipe already has a wakeup queued */
+	if (write(load_pipe[1], &c, 1) < 0 && errno != EAGAIN)
+		log_to_file(__func__, __LINE__, "write: %s", strerror(errno));
+}
+
+#if defined(__linux__)
+static int
+read_entries(Loader *ld, int fd)
+{
+	uint64_t buf[DENTS_BUF_LEN / sizeof(uint64_t)];
+	const Dirent64 *dent;
+	Window *win = &ld->window;
+	int64_t prev = 0; /* offset of the next entry */
+	long nread, pos;
+
+	/* one pass over the directory, no count and rewind */
+	while ((nread = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+		if (load_cancelled(ld))
+			return 0;
+		for (pos = 0; pos < nread; pos += dent->d_reclen) {
+			dent = (const Dirent64 *)((char *)buf + pos);
+			if (should_skip_entry(dent->d_name, 1)) {
+				prev = dent->d_off;
+				continue;
+			}
+			/* hidden entries are kept for the view */
+			if (ld->windowed == 0)
+				add_entry(ld, fd, dent->d_name, dent->d_type);
+
+			/* a window is filtered when it is read */
+			if (should_skip_entry(dent->d_name, win->dotfiles) == 0)
+				count_entry(ld, prev);
+			prev = dent->d_off;
+		}
+		if (over_budget(ld)) {
+			errno = EFBIG;
+			return -1;
+		}
+	}
+
+	if (nread < 0) {
+		log_to_file(__func__, __LINE__, "getdents64 error for %s: %s",
+			ld->path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static void
+count_entry(Loader *ld, int64_t off)
+{
+	Window *win = &ld->window;
+
+	if (window_min > 0 && win->total % win->stride == 0)
+		add_offset(win, off);
+	win->total++;
+
+	if (ld->windowed && win->total % LOAD_BATCH_MAX == 0) {
+		pthread_mutex_lock(&ld->lock);
+		ld->counted = win->total;
+		pthread_mutex_unlock(&ld->lock);
+		notify_loaded(ld);
+	}
+
+	/* too big to keep, only count and index the rest */
+	if (window_min > 0 && ld->windowed == 0 && win->total >= window_min) {
+		ld->windowed = 1;
+		ld->batch_count = 0;
+	}
+}
+
+static void
+add_offset(Window *win, int64_t off)
+{
+	int i;
+
+	/* keep every other offset, memory stays bounded */
+	if (win->count == WINDOW_OFFSETS) {
+		for (i = 0; i < WINDOW_OFFSETS / 2; i++)
+			win->offsets[i] = win->offsets[i * 2];
+		win->count = WINDOW_OFFSETS / 2;
+		win->stride *= 2;
+	}
+	if (win->offsets == NULL)
+		win->offsets = ecalloc(WINDOW_OFFSETS, sizeof(int64_t));
+	win->offsets[win->count++] = off;
+}
+
+static void
+load_window(Pane *pane)
+{
+	Window *win = &pane->window;
+	Loader *ld;
+	sigset_t oldset;
+	int cur, first, size, err;
+
+	/* a full load replaces the window anyway */
+	if (pane->loader != NULL && pane->loader->refill == 0)
+		return;
+
+	/* indexes are relative to the window shown */
+	cur = win->first + pane->current_index;
+	size = MAX(window_entries, (term.rows - 2) * 4);
+	first = MIN(cur - size / 2, win->total - size);
+	first = MAX(first, 0);
+
+	ld = new_loader(pane, pane->path);
+	ld->refill = 1;
+	ld->seek = win->offsets[first / win->stride];
+	ld->skip = first % win->stride;
+	ld->size = size;
+	ld->window.first = first;
+	ld->window.dotfiles = win->dotfiles;
+	ld->slow = pane->slow;
+	ld->dirfd = fcntl(pane->dirfd, F_DUPFD_CLOEXEC, 0);
+	stop_loader(pane);
+	if (ld->dirfd < 0) {
+		print_status(color_err, strerror(errno));
+		free_loader(ld);
+		return;
+	}
+
+	/* the thread inherits the blocked signals */
+	block_signals(&oldset);
+	err = pthread_create(&ld->thread, NULL, window_worker, ld);
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+	if (err != 0) {
+		print_status(color_err, strerror(err));
+		free_loader(ld);
+		return;
+	}
+	/* the pane shows the old window until this one is read */
+	pane->loader = ld;
+}
+
+static void *
+window_worker(void *arg)
+{
+	Loader *ld = (Loader *)arg;
+	uint64_t buf[DENTS_BUF_LEN / sizeof(uint64_t)];
+	const Dirent64 *dent;
+	Entry *ent;
+	int fd, n = 0, skip = ld->skip, err;
+	long nread = 0, pos;
+
+	/*
+	 * a dup shares the file offset, and a cancelled window may
+	 * still be reading, so seek on a file of its own
+	 */
+	fd = openat(ld->dirfd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		finish_load(ld, errno);
+		return NULL;
+	}
+
+	/* the main thread only looks at these once done is set */
+	ld->pending = ecalloc(ld->size, sizeof(Entry));
+	ld->pending_order = ecalloc(ld->size, sizeof(int));
+	if (lseek(fd, ld->seek, SEEK_SET) < 0)
+		nread = -1;
+	while (nread >= 0 && n < ld->size && load_cancelled(ld) == 0 &&
+		(nread = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+		for (pos = 0; pos < nread && n < ld->size;
+			pos += dent->d_reclen) {
+			dent = (const Dirent64 *)((char *)buf + pos);
+			if (should_skip_entry(dent->d_name,
+				ld->window.dotfiles) != 0)
+				continue;
+			if (skip > 0) {
+				skip--;
+				continue;
+			}
+			ld->pending_order[n] = n; /* never sorted */
+			ent = &ld->pending[n++];
+			ent->name = arena_strdup(&ld->pending_names,
+				dent->d_name, strnlen(dent->d_name, NAME_MAX));
+			ent->mode = dtype_to_mode(dent->d_type);
+			if (ent->mode != 0)
+				set_entry_color(ent);
+		}
+	}
+	err = nread < 0 ? errno : 0;
+
+	if (load_cancelled(ld) == 0)
+		stat_entries(ld->pending, n, fd, lazy_stat || ld->slow);
+	close(fd);
+
+	pthread_mutex_lock(&ld->lock);
+	ld->counted = n;
+	pthread_mutex_unlock(&ld->lock);
+	finish_load(ld, err);
+	return NULL;
+}
+
+static void
+merge_window(Pane *pane)
+{
+	Loader *ld = pane->loader;
+	Window *win = &pane->window;
+	int cur, top, n, done, err;
+
+	pthread_mutex_lock(&ld->lock);
+	done = ld->done;
+	n = ld->counted;
+	err = ld->error;
+	pthread_mutex_unlock(&ld->lock);
+	if (done == 0)
+		return;
+
+	pthread_join(ld->thread, NULL);
+	pane->loader = NULL;
+
+	/* a directory that could not be opened keeps the old window */
+	if (ld->pending != NULL) {
+		/* indexes come in relative to the old window */
+		cur = win->first + pane->current_index;
+		top = win->first + pane->start_index;
 
-	if (pane->entries != NULL) {
 		free(pane->entries);
-		pane->entries = NULL;
+		arena_free(&pane->names);
+		free_orders(pane->orders);
+		pane->entries = ld->pending;
+		pane->orders[SortName] = ld->pending_order;
+		arena_move(&pane->names, &ld->pending_names);
+		ld->pending = NULL;
+		ld->pending_order = NULL;
+		pane->entry_count = n;
+		build_view(pane, NULL);
+		win->first = ld->window.first;
+		pane->current_index = MIN(cur - win->first, MAX(n - 1, 0));
+		pane->start_index =
+			MAX(MIN(top - win->first, pane->current_index), 0);
+	}
+	free_loader(ld);
+	if (err != 0 && pane == current_pane)
+		errno = err; /* shown by update_screen */
+}
+#else
+static int
+read_entries(Loader *ld, int fd)
+{
+	int dfd;
+	DIR *dir;
+	const struct dirent *dent;
+
+	/* fd stays open for stat_entries */
+	dfd = dup(fd);
+	if (dfd < 0)
+		return -1;
+
+	dir = fdopendir(dfd);
+	if (dir == NULL) {
+		close(dfd);
+		return -1;
+	}
+
+	while ((dent = readdir(dir)) != NULL) {
+		if (should_skip_entry(dent->d_name, 1) == 0)
+			add_entry(ld, fd, dent->d_name, dent->d_type);
+		if (ld->batch_count == 0 && load_cancelled(ld))
+			break;
+		if (over_budget(ld)) {
+			closedir(dir);
+			errno = EFBIG;
+			return -1;
+		}
 	}
 
-	fd = open(pane->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
-	if (fd < 0) {
-		print_status(color_err, strerror(errno));
+	if (closedir(dir) < 0)
+		die("closedir:");
+	return 0;
+}
+#endif
+
+static void
+fit_window(Pane *pane)
+{
+#if defined(__linux__)
+	Window *win = &pane->window;
+
+	if (win->offsets == NULL)
+		return;
+	/* the cursor or the screen below it left the window */
+	if (pane->current_index < 0 || pane->start_index < 0 ||
+		pane->current_index >= pane->view_count ||
+		(pane->start_index + term.rows - 2 > pane->view_count &&
+			win->first + pane->view_count < win->total))
+		load_window(pane);
+#endif
+}
+
+static int
+pane_total(Pane *pane)
+{
+	return pane->window.offsets ? pane->window.total : pane->view_count;
+}
+
+static int
+over_budget(Loader *ld)
+{
+	/* a prefetch gives up on big directories, they load when opened */
+	if (ld->prefetch == 0)
+		return 0;
+	return ld->windowed || ld->counted + ld->batch_count > prefetch_max;
+}
+
+static void
+add_entry(Loader *ld, int fd, const char *name, unsigned char type)
+{
+	Entry *ent;
+
+	if (ld->batch_count == ld->batch_cap) {
+		ld->batch_cap = ld->batch_cap ? ld->batch_cap * 2 : 64;
+		ld->batch = erealloc(ld->batch, ld->batch_cap * sizeof(Entry));
+	}
+
+	ent = &ld->batch[ld->batch_count++];
+	memset(ent, 0, sizeof(Entry));
+	ent->name = arena_strdup(&ld->names, name, strnlen(name, NAME_MAX));
+
+	set_name_key(&ld->names, ent);
+
+	/* enough to sort and color until the entry is stat'ed */
+	ent->mode = dtype_to_mode(type);
+	if (ent->mode != 0)
+		set_entry_color(ent);
+
+	if (ld->batch_count >= ld->batch_target) {
+		ld->batch_target = MIN(ld->batch_target * 2, LOAD_BATCH_MAX);
+		flush_batch(ld, fd);
+	}
+}
+
+static void
+flush_batch(Loader *ld, int fd)
+{
+	struct timespec start, end;
+	long usec;
+	int n = ld->batch_count;
+	int i, lazy, slow = 0;
+
+	ld->batch_count = 0;
+	if (n == 0 || load_cancelled(ld))
+		return;
+
+	/* a prefetch stats like the pane would, off the UI thread */
+	lazy = lazy_stat || ld->slow;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	stat_entries(ld->batch, n, fd, lazy);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	usec = (end.tv_sec - start.tv_sec) * 1000000 +
+		(end.tv_nsec - start.tv_nsec) / 1000;
+	/* local but slow to answer, switch to lazy for the rest */
+	if (lazy == 0 && usec / n > slow_stat_usec) {
+		slow = 1;
+		ld->batch_target = LOAD_BATCH_MAX;
+	}
+	ld->batch_order = erealloc(ld->batch_order, n * sizeof(int));
+	for (i = 0; i < n; i++)
+		ld->batch_order[i] = i;
+	sort_order(ld->batch, ld->batch_order, n, SortName);
+
+	/* hand the sorted batch to the main thread */
+	pthread_mutex_lock(&ld->lock);
+	if (ld->pending_count + n > ld->pending_cap) {
+		ld->pending_cap =
+			MAX(ld->pending_count + n, ld->pending_cap * 2);
+		ld->pending =
+			erealloc(ld->pending, ld->pending_cap * sizeof(Entry));
+		ld->pending_order = erealloc(
+			ld->pending_order, ld->pending_cap * sizeof(int));
+	}
+	memcpy(&ld->pending[ld->pending_count], ld->batch, n * sizeof(Entry));
+	merge_order(ld->pending, ld->pending_order, ld->pending_count,
+		ld->batch_order, n, ld->pending_count, SortName);
+	ld->pending_count += n;
+	ld->counted += n;
+	ld->slow |= slow;
+	arena_move(&ld->pending_names, &ld->names);
+	pthread_mutex_unlock(&ld->lock);
+
+	notify_loaded(ld);
+}
+
+static void
+handle_loaded(void)
+{
+	char buf[64];
+	int loading;
+
+	while (read(load_pipe[0], buf, sizeof(buf)) > 0)
+		;
+	errno = 0;
+
+	loading = panes[Left].loader != NULL || panes[Right].loader != NULL;
+	merge_loaded(&panes[Left]);
+	merge_loaded(&panes[Right]);
+	if (loading)
+		schedule_redraw(); /* with the error of a failed load */
+	if (merge_stats(&panes[Left]) | merge_stats(&panes[Right]))
+		schedule_redraw();
+	merge_prefetch();
+
+	/* a file written in a shown directory may change nothing shown */
+	if (apply_events(&panes[Left]))
+		schedule_redraw();
+	if (apply_events(&panes[Right]))
+		schedule_redraw();
+	if (listings_usec < 0 && panes[Left].loader == NULL &&
+		panes[Right].loader == NULL)
+		listings_usec = log_startup("listings");
+}
+
+static void
+merge_loaded(Pane *pane)
+{
+	Loader *ld = pane->loader;
+	const char *cur_name = NULL;
+	int i, n, base, old_cur, new_cur, done, err;
+
+	if (ld == NULL)
+		return;
+#if defined(__linux__)
+	if (ld->refill) {
+		merge_window(pane);
+		return;
+	}
+#endif
+
+	pthread_mutex_lock(&ld->lock);
+	n = ld->pending_count;
+	done = ld->done;
+	err = ld->error;
+	/* a failed load leaves the old listing alone, as does a check */
+	if (ld->swapped == 0 &&
+		(n > 0 || (done && err == 0 && ld->unchanged == 0)))
+		swap_listing(pane, ld);
+	if (ld->swapped) {
+		pane->window.total = ld->counted;
+		pane->slow = ld->slow;
+		memcpy(pane->fstype, ld->fstype, FSTYPE_MAX);
+	}
+	if (n > 0) {
+		arena_move(&pane->names, &ld->pending_names);
+		old_cur = new_cur = pane->current_index;
+		/* the top row stays the top row, any other follows its entry */
+		if (ld->keep[0] != '\0' && ld->kept == 0)
+			cur_name = ld->keep;
+		else if ((old_cur > 0 || ld->kept) &&
+			old_cur < pane->view_count)
+			cur_name = pane_entry(pane, old_cur)->name;
+
+		/* entries are only appended, both orders are sorted */
+		base = pane->entry_count;
+		pane->entries =
+			erealloc(pane->entries, (base + n) * sizeof(Entry));
+		memcpy(&pane->entries[base], ld->pending, n * sizeof(Entry));
+		merge_orders(pane, ld->pending_order, base, n);
+		ld->pending_count = 0;
+		pane->entry_count = base + n;
+
+		/* keep the cursor on its entry */
+		i = build_view(pane, cur_name);
+		if (i >= 0 && ld->keep[0] != '\0' && ld->kept == 0) {
+			/* and on its row, the reload started from it */
+			ld->kept = 1;
+			pane->current_index = i;
+			pane->start_index = MAX(0, i - ld->keep_row);
+		} else {
+			if (i >= 0)
+				new_cur = i;
+			pane->current_index = new_cur;
+			pane->start_index =
+				MAX(0, pane->start_index + new_cur - old_cur);
+		}
+		/* a partial listing may not reach the cursor yet */
+		pane->current_index = MIN(pane->current_index,
+			MAX(pane->view_count - 1, 0));
+		pane->start_index =
+			MIN(pane->start_index, pane->current_index);
+	}
+	pthread_mutex_unlock(&ld->lock);
+
+	if (done == 0)
+		return;
+
+	pthread_join(ld->thread, NULL);
+	pane->loader = NULL;
+	if (ld->swapped && err == 0)
+		pane->partial = 0;
+	if (ld->unchanged) {
+		/* the snapshot was right, it only lacks a dirfd */
+		pane->dirfd = fcntl(ld->dirfd, F_DUPFD_CLOEXEC, 0);
+		pane->slow = ld->slow;
+		memcpy(pane->fstype, ld->fstype, FSTYPE_MAX);
+		pane->partial = 0;
+		stat_all(pane); /* its entries come in unstated */
+	}
+	set_watch_slow(pane); /* known once the load is done */
+#if defined(__linux__)
+	if (ld->windowed && pane->dirfd >= 0) {
+		/* from now on only the entries around the cursor are kept */
+		pane->window = ld->window;
+		pane->window.first = 0;
+		memset(&ld->window, 0, sizeof(Window));
+		if (ld->keep[0] != '\0') {
+			/* sorted places mean nothing in a window */
+			pane->current_index = ld->keep_index;
+			pane->start_index = MAX(0, ld->keep_index -
+				ld->keep_row);
+		}
+		load_window(pane);
+	}
+#endif
+	free_loader(ld);
+	if (err != 0 && pane == current_pane)
+		errno = err; /* shown by update_screen */
+}
+
+static void
+request_reload(Pane *pane, int kind)
+{
+	pane->reload = MAX(pane->reload, kind);
+}
+
+static int
+reload_wait(void)
+{
+	int i, ms, wait = -1;
+
+	/* a loading pane is looked at again once its load is merged */
+	for (i = Left; i <= Right; i++) {
+		if (panes[i].reload == ReloadNone || panes[i].loader != NULL)
+			continue;
+		ms = time_left(&panes[i].reload_time, reload_delay);
+		if (wait < 0 || ms < wait)
+			wait = ms;
+	}
+	return wait;
+}
+
+static void
+run_reloads(void)
+{
+	Pane *pane;
+	int i;
+
+	/* a busy directory is reread at most every reload_delay ms */
+	for (i = Left; i <= Right; i++) {
+		pane = &panes[i];
+		if (pane->reload == ReloadNone || pane->loader != NULL ||
+			time_left(&pane->reload_time, reload_delay) > 0)
+			continue;
+		clock_gettime(CLOCK_MONOTONIC, &pane->reload_time);
+#if defined(__linux__)
+		if (pane->reload == ReloadWindow &&
+			pane->window.offsets != NULL && pane->dirfd >= 0)
+			load_window(pane);
+		else
+#endif
+			set_pane_entries(pane, pane->path);
+		pane->reload = ReloadNone;
+		schedule_redraw();
+	}
+}
+
+static int
+build_view(Pane *pane, const char *keep)
+{
+	Entry *ent;
+	int *order = pane_order(pane);
+	int i, k, dotfiles, found = -1;
+
+	/* a window is filtered when it is read */
+	dotfiles = pane->window.offsets != NULL ? 1 : show_dotfiles;
+
+	pane->view =
+		erealloc(pane->view, MAX(pane->entry_count, 1) * sizeof(int));
+	if (pane->matched_indices != NULL)
+		pane->matched_indices = erealloc(pane->matched_indices,
+			MAX(pane->entry_count, 1) * sizeof(int));
+	pane->view_count = 0;
+	pane->matched_count = 0;
+
+	for (k = 0; k < pane->entry_count; k++) {
+		i = order[k];
+		ent = &pane->entries[i];
+		if (should_skip_entry(ent->name, dotfiles))
+			continue;
+		if (ent->name == keep)
+			found = pane->view_count;
+		/* search matches are view positions too */
+		if (pane->matched_indices != NULL && ent->matched)
+			pane->matched_indices[pane->matched_count++] =
+				pane->view_count;
+		pane->view[pane->view_count++] = i;
+	}
+	return found;
+}
+
+static Entry *
+pane_entry(Pane *pane, int index)
+{
+	return &pane->entries[pane->view[index]];
+}
+
+static int
+find_order(const Entry *entries, const int *order, int count,
+	const Entry *ent, int mode)
+{
+	int lo = 0, hi = count, mid;
+
+	/* the first position not before ent */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (entry_compare(&entries[order[mid]], ent, mode) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int
+order_index(const Entry *entries, const int *order, int count, int index,
+	int mode)
+{
+	int pos;
+
+	pos = find_order(entries, order, count, &entries[index], mode);
+	if (pos < count && order[pos] == index)
+		return pos;
+
+	/* a lazy stat may have changed the entry after it was sorted */
+	for (pos = 0; pos < count && order[pos] != index; pos++)
+		;
+	return pos;
+}
+
+static void
+link_entry(Pane *pane, int index, int count)
+{
+	int *order, mode, pos;
+
+	/* count is the length of the orders, index is not in them yet */
+	for (mode = 0; mode < SORT_MODES; mode++) {
+		if (pane->orders[mode] == NULL && mode != SortName)
+			continue;
+		order = erealloc(pane->orders[mode], (count + 1) * sizeof(int));
+		pos = find_order(pane->entries, order, count,
+			&pane->entries[index], mode);
+		memmove(&order[pos + 1], &order[pos],
+			(count - pos) * sizeof(int));
+		order[pos] = index;
+		pane->orders[mode] = order;
+	}
+}
+
+static void
+unlink_entry(Pane *pane, int index, int count)
+{
+	int *order, mode, pos;
+
+	for (mode = 0; mode < SORT_MODES; mode++) {
+		if ((order = pane->orders[mode]) == NULL)
+			continue;
+		pos = order_index(pane->entries, order, count, index, mode);
+		if (pos == count)
+			continue;
+		memmove(&order[pos], &order[pos + 1],
+			(count - pos - 1) * sizeof(int));
+	}
+}
+
+static void
+remove_entry(Pane *pane, int index)
+{
+	int last = pane->entry_count - 1, mode, pos;
+
+	unlink_entry(pane, index, pane->entry_count);
+
+	/* the last entry fills the hole, its orders follow it */
+	if (index != last) {
+		for (mode = 0; mode < SORT_MODES; mode++) {
+			if (pane->orders[mode] == NULL)
+				continue;
+			pos = order_index(pane->entries, pane->orders[mode],
+				last, last, mode);
+			if (pos < last)
+				pane->orders[mode][pos] = index;
+		}
+		pane->entries[index] = pane->entries[last];
+	}
+	pane->entry_count = last;
+}
+
+static int
+find_named(Pane *pane, Entry *probe)
+{
+	static const mode_t types[] = { 0, S_IFIFO, S_IFCHR, S_IFDIR,
+		S_IFBLK, S_IFREG, S_IFLNK, S_IFSOCK };
+	const int *order = pane->orders[SortName];
+	size_t t;
+	int pos, found = -1;
+
+	if (order == NULL)
+		return -1;
+
+	/* the name order goes by type first, which the event does not tell */
+	for (t = 0; t < LEN(types) && found < 0; t++) {
+		probe->mode = types[t];
+		pos = find_order(pane->entries, order, pane->entry_count, probe,
+			SortName);
+		if (pos < pane->entry_count &&
+			strncmp(pane->entries[order[pos]].name, probe->name,
+				NAME_MAX) == 0)
+			found = order[pos];
+	}
+	probe->mode = 0;
+	return found;
+}
+
+static int
+update_named(Pane *pane, const char *name, Arena *scratch)
+{
+	Entry ent, *old;
+	int i, n = pane->entry_count, shown, pos, moved;
+
+	memset(&ent, 0, sizeof(Entry));
+	ent.name = arena_strdup(scratch, name, strlen(name));
+	set_name_key(scratch, &ent);
+	if ((i = find_named(pane, &ent)) >= 0)
+		ent = pane->entries[i]; /* keeps selected and matched */
+
+	if (stat_entry(pane->dirfd, &ent) < 0) {
+		/* gone again before the event got here */
+		if (i >= 0)
+			remove_entry(pane, i);
+		return i >= 0;
+	}
+
+	if (i >= 0) {
+		old = &pane->entries[i];
+		if (ent.size == old->size && ent.mtime == old->mtime &&
+			ent.mode == old->mode && ent.uid == old->uid &&
+			ent.gid == old->gid)
+			return 0;
+
+		/* changed in place unless it moves in the shown order */
+		shown = pane->orders[sort_mode] != NULL ? sort_mode : SortName;
+		pos = order_index(
+			pane->entries, pane->orders[shown], n, i, shown);
+		moved = ent.mode != old->mode; /* its color */
+		unlink_entry(pane, i, n);
+		*old = ent;
+		link_entry(pane, i, n - 1);
+		return moved ||
+			order_index(pane->entries, pane->orders[shown], n, i,
+				shown) != pos;
+	}
+
+	ent.name = arena_strdup(&pane->names, name, strlen(name));
+	ent.key = NULL;
+	set_name_key(&pane->names, &ent);
+	if (pane->matched_indices != NULL) {
+		ent.matched = strcasestr(name, pane->search_term) != NULL;
+		set_entry_color(&ent);
+	}
+	pane->entries = erealloc(pane->entries, (n + 1) * sizeof(Entry));
+	pane->entries[n] = ent;
+	link_entry(pane, n, n);
+	pane->entry_count = n + 1;
+	return 1;
+}
+
+static int
+held_named(Pane *pane, const char *name, Arena *scratch)
+{
+	return entry_named(pane, name, scratch) >= 0;
+}
+
+static int
+entry_named(Pane *pane, const char *name, Arena *scratch)
+{
+	Entry probe;
+
+#if defined(__linux__)
+	if (pane->window.offsets != NULL)
+		return window_named(pane, name);
+#endif
+	memset(&probe, 0, sizeof(Entry));
+	probe.name = arena_strdup(scratch, name, strlen(name));
+	set_name_key(scratch, &probe);
+	return find_named(pane, &probe);
+}
+
+static int
+remove_named(Pane *pane, const char *name, Arena *scratch)
+{
+	Entry probe;
+	int i;
+
+	memset(&probe, 0, sizeof(Entry));
+	probe.name = arena_strdup(scratch, name, strlen(name));
+	set_name_key(scratch, &probe);
+	if ((i = find_named(pane, &probe)) < 0)
+		return 0;
+	remove_entry(pane, i);
+	return 1;
+}
+
+static void
+swap_listing(Pane *pane, Loader *ld)
+{
+	int moved = strncmp(pane->path, ld->path, PATH_MAX) != 0;
+
+	if (moved) {
+		pane->current_index = 0;
+		pane->start_index = 0;
+	} else {
+		/* a reload keeps the cursor on its entry, see merge_loaded */
+		if (pane->current_index >= 0 &&
+			pane->current_index < pane->view_count) {
+			snprintf(ld->keep, sizeof(ld->keep), "%s",
+				pane_entry(pane, pane->current_index)->name);
+			ld->keep_row = pane->current_index - pane->start_index;
+		}
+		/* a reloaded window keeps its place in the directory */
+		pane->current_index += pane->window.first;
+		pane->start_index += pane->window.first;
+		ld->keep_index = pane->current_index;
+	}
+	if (moved)
+		cache_store(pane);
+	free_entries(pane);
+	free(pane->matched_indices);
+	pane->matched_indices = NULL;
+	pane->matched_count = 0;
+	if (ld->dirfd >= 0)
+		pane->dirfd = fcntl(ld->dirfd, F_DUPFD_CLOEXEC, 0);
+	pane->stamp = ld->stamp;
+	pane->partial = 1;
+
+	if (moved) {
+		remove_watch(pane);
+		strncpy(pane->path, ld->path, PATH_MAX - 1);
+		add_watch(pane);
+	}
+	ld->swapped = 1;
+}
+
+static void
+set_stamp(DirStamp *stamp, const struct stat *st)
+{
+	stamp->dev = st->st_dev;
+	stamp->ino = st->st_ino;
+	stamp->mtime = st->M_TIME;
+	stamp->ctime = st->C_TIME;
+}
+
+static int
+same_stamp(const DirStamp *a, const DirStamp *b)
+{
+	return a->dev == b->dev && a->ino == b->ino &&
+		a->mtime.tv_sec == b->mtime.tv_sec &&
+		a->mtime.tv_nsec == b->mtime.tv_nsec &&
+		a->ctime.tv_sec == b->ctime.tv_sec &&
+		a->ctime.tv_nsec == b->ctime.tv_nsec;
+}
+
+static void
+handle_cache_events(void)
+{
+#if defined(__linux__)
+	char buf[EV_BUF_LEN];
+	struct inotify_event *event;
+	ssize_t len, off;
+	int i;
+
+	if (cache_fd < 0)
+		return;
+	while ((len = read(cache_fd, buf, sizeof(buf))) > 0) {
+		for (off = 0; off < len;
+			off += sizeof(*event) + event->len) {
+			event = (struct inotify_event *)(buf + off);
+			for (i = 0; i < cache_size; i++)
+				if (cache[i].used &&
+					cache[i].watch == event->wd)
+					cache[i].stale = 1;
+		}
+	}
+	errno = 0; /* drained, not an error to show */
+#endif
+}
+
+static Listing *
+cache_lookup(const char *path)
+{
+	struct stat st;
+	DirStamp now;
+	int i;
+
+	/* events still queued would make a hit stale */
+	handle_cache_events();
+	for (i = 0; i < cache_size; i++) {
+		if (cache[i].used == 0 ||
+			strncmp(cache[i].path, path, PATH_MAX) != 0)
+			continue;
+		if (cache[i].stale)
+			break;
+		if (cache[i].watch >= 0)
+			return &cache[i];
+		if (stat(path, &st) < 0)
+			break;
+		set_stamp(&now, &st);
+		if (!same_stamp(&now, &cache[i].stamp))
+			break;
+		return &cache[i];
+	}
+	if (i < cache_size)
+		cache_drop(&cache[i]);
+	return NULL;
+}
+
+static void
+cache_store(Pane *pane)
+{
+	Listing *l = NULL;
+	struct stat st;
+	DirStamp now;
+	int i;
+
+	if (cache_size <= 0 || pane->partial || pane->window.offsets != NULL)
+		return;
+
+	/* the same directory, else a free slot or the least recently used */
+	for (i = 0; i < cache_size; i++) {
+		if (cache[i].used &&
+			strncmp(cache[i].path, pane->path, PATH_MAX) == 0) {
+			l = &cache[i];
+			break;
+		}
+		if (l == NULL || cache[i].used < l->used)
+			l = &cache[i];
+	}
+	if (l->used)
+		cache_drop(l);
+
+	l->watch = -1;
+#if defined(__linux__)
+	if (cache_fd >= 0)
+		l->watch = inotify_add_watch(cache_fd, pane->path,
+			IN_CREATE | IN_DELETE | IN_MOVE | IN_DELETE_SELF |
+				IN_MOVE_SELF);
+#endif
+	/* after the watch, any later change shows up as an event */
+	if (stat(pane->path, &st) < 0) {
+		cache_unwatch(l);
+		return;
+	}
+	set_stamp(&now, &st);
+	if (!same_stamp(&now, &pane->stamp)) {
+		cache_unwatch(l);
+		return;
+	}
+
+	snprintf(l->path, sizeof(l->path), "%s", pane->path);
+	l->stamp = pane->stamp;
+	l->entries = pane->entries;
+	memcpy(l->orders, pane->orders, sizeof(l->orders));
+	l->entry_count = pane->entry_count;
+	l->names = pane->names;
+	l->dirfd = pane->dirfd;
+	l->slow = pane->slow;
+	memcpy(l->fstype, pane->fstype, FSTYPE_MAX);
+	l->cursor = NULL;
+	l->row = 0;
+	if (pane->current_index < pane->view_count) {
+		l->cursor = pane_entry(pane, pane->current_index)->name;
+		l->row = pane->current_index - pane->start_index;
+	}
+	l->stale = 0;
+	l->used = ++cache_tick;
+
+	/* now owned by the cache */
+	pane->entries = NULL;
+	memset(pane->orders, 0, sizeof(pane->orders));
+	pane->entry_count = 0;
+	pane->names.head = NULL;
+	pane->dirfd = -1;
+}
+
+static void
+cache_restore(Pane *pane, Listing *hit)
+{
+	Listing l = *hit;
+	int i, index;
+
+	/* the slot is free before the pane's listing goes in */
+	memset(hit, 0, sizeof(Listing));
+	cache_unwatch(&l);
+	cache_store(pane);
+
+	free_entries(pane);
+	free(pane->matched_indices);
+	pane->matched_indices = NULL;
+	pane->matched_count = 0;
+
+	/* selections and matches belong to the visit that made them */
+	for (i = 0; i < l.entry_count; i++) {
+		l.entries[i].selected = 0;
+		l.entries[i].matched = 0;
+	}
+	pane->entries = l.entries;
+	memcpy(pane->orders, l.orders, sizeof(pane->orders));
+	pane->entry_count = l.entry_count;
+	pane->names = l.names;
+	pane->dirfd = l.dirfd;
+	pane->slow = l.slow;
+	memcpy(pane->fstype, l.fstype, FSTYPE_MAX);
+	pane->stamp = l.stamp;
+	pane->partial = 0;
+
+	remove_watch(pane);
+	strncpy(pane->path, l.path, PATH_MAX - 1);
+	add_watch(pane);
+
+	index = build_view(pane, l.cursor);
+	pane->current_index = MAX(index, 0);
+	pane->start_index = MAX(pane->current_index - l.row, 0);
+}
+
+static void
+cache_unwatch(Listing *l)
+{
+#if defined(__linux__)
+	int i;
+
+	if (l->watch < 0)
+		return;
+	/* two paths to one directory share the descriptor */
+	for (i = 0; i < cache_size; i++)
+		if (&cache[i] != l && cache[i].used &&
+			cache[i].watch == l->watch)
+			break;
+	if (i == cache_size)
+		inotify_rm_watch(cache_fd, l->watch);
+#endif
+	l->watch = -1;
+}
+
+static void
+cache_drop(Listing *l)
+{
+	cache_unwatch(l);
+	if (l->dirfd >= 0)
+		close(l->dirfd);
+	free(l->entries);
+	free_orders(l->orders);
+	arena_free(&l->names);
+	memset(l, 0, sizeof(Listing));
+}
+
+static void
+cache_free(void)
+{
+	int i;
+
+	for (i = 0; i < cache_size; i++)
+		if (cache[i].used)
+			cache_drop(&cache[i]);
+	free(cache);
+	cache = NULL;
+	if (cache_fd >= 0)
+		close(cache_fd);
+}
+
+static int
+snapshot_path(char *path, size_t len)
+{
+	const char *dir = getenv("XDG_CACHE_HOME");
+	int ret;
+
+	if (dir != NULL && dir[0] != '\0')
+		ret = snprintf(path, len, "%s/%s", dir, SNAPSHOT_FILE);
+	else
+		ret = snprintf(
+			path, len, "%s/.cache/%s", home, SNAPSHOT_FILE);
+	return ret < 0 || (size_t)ret >= len ? -1 : 0;
+}
+
+static void
+save_snapshot(void)
+{
+	char path[PATH_MAX], tmp[PATH_MAX + 4], *slash;
+	SnapHeader hdr;
+	FILE *fp;
+	int i, err;
+
+	if (use_snapshot == 0 || snapshot_path(path, sizeof(path)) < 0)
+		return;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = SNAPSHOT_MAGIC;
+	hdr.listing_size = sizeof(SnapListing);
+	hdr.entry_size = sizeof(SnapEntry);
+	hdr.name_order = name_order;
+	for (i = 0; i < 2; i++)
+		if (panes[i].partial == 0 && panes[i].window.offsets == NULL)
+			hdr.count++;
+	if (hdr.count == 0)
+		return;
+
+	/* ~/.cache may not exist yet */
+	strncpy(tmp, path, sizeof(tmp) - 1);
+	tmp[sizeof(tmp) - 1] = '\0';
+	if ((slash = strrchr(tmp, '/')) != NULL) {
+		*slash = '\0';
+		mkdir(tmp, S_IRWXU);
+	}
+
+	/* a half written snapshot must never be read */
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	fp = fopen(tmp, "w");
+	if (fp == NULL) {
+		log_to_file(__func__, __LINE__, "fopen %s: %s", tmp,
+			strerror(errno));
+		return;
+	}
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+	for (i = 0; i < 2; i++)
+		if (panes[i].partial == 0 && panes[i].window.offsets == NULL)
+			write_listing(fp, &panes[i]);
+	err = ferror(fp);
+	if (fclose(fp) != 0 || err || rename(tmp, path) < 0) {
+		log_to_file(__func__, __LINE__, "write %s: %s", path,
+			strerror(errno));
+		unlink(tmp);
+	}
+}
+
+static void
+write_listing(FILE *fp, Pane *pane)
+{
+	static const char zero[8];
+	SnapListing l;
+	SnapEntry se;
+	Entry *ent;
+	uint32_t off = 0;
+	int i;
+
+	memset(&l, 0, sizeof(l));
+	memcpy(l.path, pane->path, sizeof(l.path) - 1);	/* memset ends it */
+	l.stamp = pane->stamp;
+	memcpy(l.fstype, pane->fstype, FSTYPE_MAX);
+	l.slow = pane->slow;
+	l.entry_count = pane->entry_count;
+	l.cursor = -1;
+	/* written in sort order, read back it needs no sorting */
+	for (i = 0; i < pane->entry_count; i++) {
+		if (pane->current_index < pane->view_count &&
+			pane->orders[SortName][i] ==
+				pane->view[pane->current_index]) {
+			l.cursor = i;
+			l.row = pane->current_index - pane->start_index;
+		}
+		l.names_size += strlen(pane->entries[i].name) + 1;
+	}
+	l.names_size = (l.names_size + 7) & ~(uint64_t)7;
+	fwrite(&l, sizeof(l), 1, fp);
+
+	memset(&se, 0, sizeof(se));
+	for (i = 0; i < pane->entry_count; i++) {
+		ent = &pane->entries[pane->orders[SortName][i]];
+		se.size = ent->size;
+		se.mtime = ent->mtime;
+		se.uid = ent->uid;
+		se.gid = ent->gid;
+		se.mode = ent->mode;
+		se.name = off;
+		se.stated = ent->stated;
+		off += strlen(ent->name) + 1;
+		fwrite(&se, sizeof(se), 1, fp);
+	}
+	for (i = 0; i < pane->entry_count; i++) {
+		ent = &pane->entries[pane->orders[SortName][i]];
+		fwrite(ent->name, strlen(ent->name) + 1, 1, fp);
+	}
+	fwrite(zero, l.names_size - off, 1, fp);
+}
+
+static void
+load_snapshot(void)
+{
+	char path[PATH_MAX];
+	const SnapHeader *hdr;
+	const SnapListing *l;
+	const char *map, *p, *end;
+	struct stat st;
+	uint64_t left;
+	uint32_t i;
+	int fd, j;
+	int saved_errno = errno;
+
+	if (use_snapshot == 0 || snapshot_path(path, sizeof(path)) < 0)
+		return;
+
+	/* no snapshot yet is not an error for the first frame */
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		errno = saved_errno;
+		return;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(SnapHeader)) {
+		close(fd);
+		errno = saved_errno;
+		return;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		errno = saved_errno;
+		return;
+	}
+
+	/* a snapshot from another build or a damaged one is ignored */
+	end = map + st.st_size;
+	hdr = (const SnapHeader *)map;
+	if (hdr->magic != SNAPSHOT_MAGIC ||
+		hdr->listing_size != sizeof(SnapListing) ||
+		hdr->entry_size != sizeof(SnapEntry) ||
+		hdr->name_order != (uint32_t)name_order) {
+		munmap((void *)map, st.st_size);
+		return;
+	}
+	p = map + sizeof(SnapHeader);
+	for (i = 0; i < hdr->count; i++) {
+		if ((size_t)(end - p) < sizeof(SnapListing))
+			break;
+		l = (const SnapListing *)p;
+		left = end - p - sizeof(SnapListing);
+		if (l->entry_count < 0 || l->names_size > left ||
+			l->entry_count * sizeof(SnapEntry) >
+				left - l->names_size)
+			break;
+		for (j = 0; j < 2; j++)
+			if (panes[j].entries == NULL &&
+				strncmp(panes[j].path, l->path, PATH_MAX) == 0)
+				read_listing(&panes[j], l);
+		p += sizeof(SnapListing) + l->entry_count * sizeof(SnapEntry) +
+			l->names_size;
+	}
+	munmap((void *)map, st.st_size);
+}
+
+static void
+read_listing(Pane *pane, const SnapListing *l)
+{
+	const SnapEntry *se = (const SnapEntry *)(l + 1);
+	const char *names = (const char *)(se + l->entry_count);
+	const char *cursor = NULL;
+	Entry *ent;
+	size_t len;
+	int i, index, row;
+
+	if (l->entry_count == 0)
+		return;
+	pane->entries = ecalloc(l->entry_count, sizeof(Entry));
+	pane->orders[SortName] = ecalloc(l->entry_count, sizeof(int));
+	for (i = 0; i < l->entry_count; i++) {
+		pane->orders[SortName][i] = i;
+		ent = &pane->entries[i];
+		if (se[i].name >= l->names_size)
+			break;
+		len = strnlen(names + se[i].name, l->names_size - se[i].name);
+		if (len == l->names_size - se[i].name || len > NAME_MAX)
+			break;
+		ent->name = arena_strdup(&pane->names, names + se[i].name, len);
+		set_name_key(&pane->names, ent);
+		ent->size = se[i].size;
+		ent->mtime = se[i].mtime;
+		ent->uid = se[i].uid;
+		ent->gid = se[i].gid;
+		ent->mode = se[i].mode;
+		/* the files may have changed since, stat them again when shown */
+		ent->stated = 0;
+		if (ent->mode != 0)
+			set_entry_color(ent);
+		if (i == l->cursor)
+			cursor = ent->name;
+	}
+	if (i < l->entry_count) {
+		free_entries(pane);
+		return;
+	}
+	pane->entry_count = l->entry_count;
+	pane->stamp = l->stamp;
+	pane->slow = l->slow;
+	memcpy(pane->fstype, l->fstype, FSTYPE_MAX);
+	pane->fstype[FSTYPE_MAX - 1] = '\0';
+	pane->validate = 1;
+
+	index = build_view(pane, cursor);
+	pane->current_index = MIN(MAX(index, 0), MAX(pane->view_count - 1, 0));
+	/* the row comes from the file, keep the cursor on the screen */
+	row = MIN(MAX(l->row, 0), MAX(term.rows - 3, 0));
+	pane->start_index = MAX(pane->current_index - row, 0);
+}
+
+static long
+log_startup(const char *what)
+{
+	struct timespec now;
+	long usec;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	usec = (now.tv_sec - start_time.tv_sec) * 1000000 +
+		(now.tv_nsec - start_time.tv_nsec) / 1000;
+	log_to_file(__func__, __LINE__, "%s after %ld us", what, usec);
+	return usec;
+}
+
+static int *
+pane_order(Pane *pane)
+{
+	int mode = sort_mode;
+
+	/* a window is never sorted */
+	if (pane->window.offsets != NULL)
+		mode = SortName;
+
+	/* every other order starts from the loader's name order */
+	if (pane->orders[mode] == NULL) {
+		/* an eager pane still missing stats gets them in the back */
+		if (mode % SortKeys == SortSize || mode % SortKeys == SortTime)
+			stat_all(pane);
+		pane->orders[mode] =
+			ecalloc(MAX(pane->entry_count, 1), sizeof(int));
+		if (pane->entry_count > 0)
+			memcpy(pane->orders[mode], pane->orders[SortName],
+				pane->entry_count * sizeof(int));
+		sort_order(pane->entries, pane->orders[mode],
+			pane->entry_count, mode);
+	}
+	return pane->orders[mode];
+}
+
+static void
+free_orders(int **orders)
+{
+	int mode;
+
+	for (mode = 0; mode < SORT_MODES; mode++) {
+		free(orders[mode]);
+		orders[mode] = NULL;
+	}
+}
+
+static void
+sort_order(const Entry *entries, int *order, int count, int mode)
+{
+	SortKey *keys, *tmp;
+	const Entry *ent;
+	sigset_t oldset;
+	int i, threads, depth = 0;
+
+	if (count < 2)
+		return;
+
+	/* sort small keys, never the entries themselves */
+	keys = ecalloc(count, sizeof(SortKey));
+	tmp = ecalloc(count, sizeof(SortKey));
+	for (i = 0; i < count; i++) {
+		ent = &entries[order[i]];
+		keys[i].type = ent->mode & S_IFMT;
+		keys[i].index = order[i];
+		switch (mode % SortKeys) {
+		case SortSize:
+			keys[i].key = (uint64_t)ent->size;
+			break;
+		case SortTime:
+			keys[i].key = (uint64_t)ent->mtime ^ (1ULL << 63);
+			break;
+		case SortExt:
+			keys[i].key = name_prefix(entry_ext(ent));
+			break;
+		default:
+			keys[i].key = name_prefix(
+				ent->key != NULL ? ent->key : ent->name);
+		}
+		if (mode >= SortKeys)
+			keys[i].key = ~keys[i].key;
+	}
+
+	threads = count >= sort_parallel_min ? sort_threads : 1;
+	while ((2 << depth) <= MIN(threads, STAT_THREADS_MAX))
+		depth++;
+	/* sort threads inherit the mask, signals stay with the main one */
+	block_signals(&oldset);
+	sort_keys(keys, tmp, count, depth, entries, mode);
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+	for (i = 0; i < count; i++)
+		order[i] = keys[i].index;
+	free(keys);
+	free(tmp);
+}
+
+static void *
+sort_worker(void *arg)
+{
+	SortJob *job = (SortJob *)arg;
+
+	sort_keys(job->keys, job->tmp, job->count, job->depth, job->entries,
+		job->mode);
+	return NULL;
+}
+
+static void
+sort_keys(SortKey *keys, SortKey *tmp, int count, int depth,
+	const Entry *entries, int mode)
+{
+	SortJob job;
+	pthread_t thread;
+	SortKey key;
+	int i, j, k, half = count / 2;
+
+	if (count <= SORT_INSERTION) {
+		for (i = 1; i < count; i++) {
+			key = keys[i];
+			for (j = i; j > 0 &&
+				key_compare(&keys[j - 1], &key, entries, mode) >
+					0;
+				j--)
+				keys[j] = keys[j - 1];
+			keys[j] = key;
+		}
+		return;
+	}
+
+	/* the left half goes to another thread while this one sorts */
+	job.keys = keys;
+	job.tmp = tmp;
+	job.count = half;
+	job.depth = depth - 1;
+	job.entries = entries;
+	job.mode = mode;
+	if (depth > 0 &&
+		pthread_create(&thread, NULL, sort_worker, &job) == 0) {
+		sort_keys(keys + half, tmp + half, count - half, depth - 1,
+			entries, mode);
+		pthread_join(thread, NULL);
+	} else {
+		sort_keys(keys, tmp, half, 0, entries, mode);
+		sort_keys(keys + half, tmp + half, count - half, 0, entries,
+			mode);
+	}
+
+	if (key_compare(&keys[half - 1], &keys[half], entries, mode) <= 0)
+		return;
+	i = 0;
+	j = half;
+	k = 0;
+	while (i < half && j < count)
+		tmp[k++] = key_compare(&keys[i], &keys[j], entries, mode) <= 0
+			? keys[i++]
+			: keys[j++];
+	while (i < half)
+		tmp[k++] = keys[i++];
+	while (j < count)
+		tmp[k++] = keys[j++];
+	memcpy(keys, tmp, count * sizeof(SortKey));
+}
+
+static int
+key_compare(const SortKey *a, const SortKey *b, const Entry *entries,
+	int mode)
+{
+	if (a->type != b->type)
+		return a->type < b->type ? -1 : 1;
+	if (a->key != b->key)
+		return a->key < b->key ? -1 : 1;
+	return entry_compare(&entries[a->index], &entries[b->index], mode);
+}
+
+static void
+merge_order(const Entry *entries, int *dst, int dst_count, const int *src,
+	int src_count, int shift, int mode)
+{
+	int i = dst_count - 1, j = src_count - 1, k = dst_count + src_count;
+
+	/* from the back, dst has room for both */
+	while (j >= 0) {
+		if (i >= 0 && entry_compare(&entries[dst[i]],
+				      &entries[src[j] + shift], mode) > 0)
+			dst[--k] = dst[i--];
+		else
+			dst[--k] = src[j--] + shift;
+	}
+}
+
+static void
+merge_orders(Pane *pane, const int *order, int base, int count)
+{
+	int *sorted, mode;
+
+	/* the name order always, the shown one if it is another */
+	for (mode = 0; mode < SORT_MODES; mode++) {
+		if (pane->orders[mode] == NULL && mode != SortName)
+			continue;
+		if (mode != SortName && mode != sort_mode) {
+			free(pane->orders[mode]);
+			pane->orders[mode] = NULL;
+			continue;
+		}
+		pane->orders[mode] = erealloc(
+			pane->orders[mode], (base + count) * sizeof(int));
+		if (mode == SortName) {
+			merge_order(pane->entries, pane->orders[mode], base,
+				order, count, base, mode);
+			continue;
+		}
+		sorted = ecalloc(count, sizeof(int));
+		memcpy(sorted, order, count * sizeof(int));
+		sort_order(pane->entries + base, sorted, count, mode);
+		merge_order(pane->entries, pane->orders[mode], base, sorted,
+			count, base, mode);
+		free(sorted);
+	}
+}
+
+static uint64_t
+name_prefix(const char *name)
+{
+	uint64_t prefix = 0;
+	int i;
+
+	/* compares like the first eight bytes of strcmp */
+	for (i = 0; i < 8 && name[i] != '\0'; i++)
+		prefix |= (uint64_t)(unsigned char)name[i] << (56 - 8 * i);
+	return prefix;
+}
+
+static void
+set_name_key(Arena *arena, Entry *ent)
+{
+	char buf[NAME_MAX * 4 + 1], *big;
+	size_t len;
+
+	if (name_order == NameNatural) {
+		len = natural_key(ent->name, buf);
+	} else if (name_order == NameLocale) {
+		len = strxfrm(buf, ent->name, sizeof(buf));
+		if (len >= sizeof(buf)) {
+			big = ecalloc(len + 1, sizeof(char));
+			strxfrm(big, ent->name, len + 1);
+			ent->key = arena_strdup(arena, big, len);
+			ent->key_len = len;
+			free(big);
+			return;
+		}
+	} else {
+		return;
+	}
+	ent->key = arena_strdup(arena, buf, len);
+	ent->key_len = len;
+}
+
+static size_t
+natural_key(const char *name, char *key)
+{
+	const char *p = name, *digits;
+	size_t len = 0, n;
+
+	/*
+	 * a run of digits becomes '0', its length and the digits without
+	 * leading zeros, so longer numbers sort after shorter ones
+	 */
+	while (*p != '\0') {
+		if (!isdigit((unsigned char)*p)) {
+			key[len++] = *p++;
+			continue;
+		}
+		while (*p == '0')
+			p++;
+		for (digits = p, n = 0; isdigit((unsigned char)*p); p++)
+			n++;
+		n = MIN(n, 254);
+		key[len++] = '0';
+		key[len++] = (char)(n + 1); /* never a NUL */
+		memcpy(&key[len], digits, n);
+		len += n;
+	}
+	key[len] = '\0';
+	return len;
+}
+
+static int
+name_compare(const Entry *a, const Entry *b)
+{
+	int ret;
+
+	/* keys first, equal ones like file2 and file02 go by bytes */
+	if (a->key != NULL && b->key != NULL) {
+		ret = memcmp(a->key, b->key, MIN(a->key_len, b->key_len));
+		if (ret == 0)
+			ret = (a->key_len > b->key_len) -
+				(a->key_len < b->key_len);
+		if (ret != 0)
+			return ret;
+	}
+	return strncmp(a->name, b->name, NAME_MAX);
+}
+
+static const char *
+entry_ext(const Entry *ent)
+{
+	const char *dot = strrchr(ent->name, '.');
+
+	/* a dotfile has no extension */
+	return dot != NULL && dot != ent->name ? dot + 1 : "";
+}
+
+static mode_t
+dtype_to_mode(unsigned char type)
+{
+	switch (type) {
+	case DT_REG:
+		return S_IFREG;
+	case DT_DIR:
+		return S_IFDIR;
+	case DT_LNK:
+		return S_IFLNK;
+	case DT_BLK:
+		return S_IFBLK;
+	case DT_CHR:
+		return S_IFCHR;
+	case DT_FIFO:
+		return S_IFIFO;
+	case DT_SOCK:
+		return S_IFSOCK;
+	default:
+		return 0; /* DT_UNKNOWN, needs a stat */
+	}
+}
+
+static void
+stat_entries(Entry *entries, int count, int dirfd, int lazy)
+{
+	StatJob job;
+	pthread_t workers[STAT_THREADS_MAX];
+	int i, nworkers;
+
+#if defined(HAVE_IO_URING)
+	/* entries the ring could not stat fall through to the workers */
+	if (use_io_uring && count >= stat_parallel_min &&
+		uring_stat_entries(entries, count, dirfd, lazy) == 0)
+		return;
+#endif
+
+	job.entries = entries;
+	job.count = count;
+	job.next = 0;
+	job.dirfd = dirfd;
+	job.lazy = lazy;
+	pthread_mutex_init(&job.lock, NULL);
+
+	/* the main thread is a worker too */
+	nworkers = MIN(stat_threads, STAT_THREADS_MAX) - 1;
+	if (job.count < stat_parallel_min)
+		nworkers = 0;
+	nworkers = MIN(nworkers, job.count / STAT_CHUNK);
+
+	for (i = 0; i < nworkers; i++) {
+		if (pthread_create(&workers[i], NULL, stat_worker, &job) != 0) {
+			log_to_file(__func__, __LINE__,
+				"pthread_create: %s", strerror(errno));
+			break;
+		}
+	}
+	nworkers = i;
+
+	stat_worker(&job);
+
+	for (i = 0; i < nworkers; i++)
+		pthread_join(workers[i], NULL);
+	pthread_mutex_destroy(&job.lock);
+}
+
+static void *
+stat_worker(void *arg)
+{
+	StatJob *job = (StatJob *)arg;
+	int i, start, end;
+
+	while (1) {
+		pthread_mutex_lock(&job->lock);
+		start = job->next;
+		job->next += STAT_CHUNK;
+		pthread_mutex_unlock(&job->lock);
+
+		if (start >= job->count)
+			break;
+		end = MIN(start + STAT_CHUNK, job->count);
+		for (i = start; i < end; i++) {
+			if (job->entries[i].stated)
+				continue;
+			/* lazy: only entries without a d_type */
+			if (job->lazy && job->entries[i].mode != 0)
+				continue;
+			stat_entry(job->dirfd, &job->entries[i]);
+		}
+	}
+	return NULL;
+}
+
+static int
+stat_entry(int dirfd, Entry *ent)
+{
+#if defined(STATX_TYPE)
+	struct statx stx;
+
+	ent->stated = 1;
+
+	/* only the fields sfm shows, see STATX_FIELDS */
+	if (statx(dirfd, ent->name, statx_flags(), STATX_FIELDS, &stx) != 0) {
+		errno = 0;
+		return -1;
+	}
+	fill_entry_statx(ent, &stx);
+#else
+	struct stat status;
+
+	ent->stated = 1;
+
+	// file deleted while getting its details
+	if (fstatat(dirfd, ent->name, &status, AT_SYMLINK_NOFOLLOW) != 0) {
+		errno = 0;
+		return -1;
+	}
+
+	ent->size = status.st_size;
+	ent->mtime = status.M_TIME.tv_sec;
+	ent->uid = status.st_uid;
+	ent->gid = status.st_gid;
+	ent->mode = status.st_mode;
+	set_entry_color(ent);
+#endif
+	return 0;
+}
+
+#if defined(STATX_TYPE)
+static int
+statx_flags(void)
+{
+	/* AT_STATX_DONT_SYNC: no GETATTR round trip on NFS and CIFS */
+	return AT_SYMLINK_NOFOLLOW | (statx_dont_sync ? AT_STATX_DONT_SYNC : 0);
+}
+
+static void
+fill_entry_statx(Entry *ent, const struct statx *stx)
+{
+	ent->stated = 1;
+	ent->size = stx->stx_size;
+	ent->mtime = stx->stx_mtime.tv_sec;
+	ent->uid = stx->stx_uid;
+	ent->gid = stx->stx_gid;
+	ent->mode = stx->stx_mode;
+	set_entry_color(ent);
+}
+#endif
+
+#if defined(HAVE_IO_URING)
+static int
+uring_init(Uring *ring, unsigned depth)
+{
+	struct io_uring_params p;
+	size_t sq_len, cq_len;
+
+	memset(ring, 0, sizeof(Uring));
+	memset(&p, 0, sizeof(p));
+	ring->fd = syscall(__NR_io_uring_setup, depth, &p);
+	if (ring->fd < 0)
+		return -1;
+
+	sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sq_len = sq_len;
+	ring->cq_len = cq_len;
+	ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	ring->sq_ring = mmap(NULL, sq_len, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->cq_ring = mmap(NULL, cq_len, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED ||
+		ring->sqes == MAP_FAILED) {
+		uring_free(ring);
+		return -1;
+	}
+
+	ring->sq_head = (unsigned *)((char *)ring->sq_ring + p.sq_off.head);
+	ring->sq_tail = (unsigned *)((char *)ring->sq_ring + p.sq_off.tail);
+	ring->sq_mask = *(unsigned *)((char *)ring->sq_ring + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)((char *)ring->sq_ring + p.sq_off.array);
+	ring->cq_head = (unsigned *)((char *)ring->cq_ring + p.cq_off.head);
+	ring->cq_tail = (unsigned *)((char *)ring->cq_ring + p.cq_off.tail);
+	ring->cq_mask = *(unsigned *)((char *)ring->cq_ring + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ring +
+		p.cq_off.cqes);
+	ring->depth = p.sq_entries;
+	return 0;
+}
+
+static void
+uring_free(Uring *ring)
+{
+	if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED)
+		munmap(ring->sq_ring, ring->sq_len);
+	if (ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED)
+		munmap(ring->cq_ring, ring->cq_len);
+	if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+		munmap(ring->sqes, ring->sqes_len);
+	if (ring->fd >= 0)
+		close(ring->fd);
+}
+
+static void
+uring_key_init(void)
+{
+	pthread_key_create(&uring_key, uring_release);
+}
+
+static void
+uring_release(void *ring)
+{
+	uring_free(ring);
+	free(ring);
+}
+
+static Uring *
+uring_get(void)
+{
+	Uring *ring;
+
+	/* refused once, as in containers, it is refused every time */
+	if (__atomic_load_n(&uring_broken, __ATOMIC_RELAXED))
+		return NULL;
+
+	/* one ring a loader thread, for all of its batches */
+	pthread_once(&uring_once, uring_key_init);
+	if ((ring = pthread_getspecific(uring_key)) != NULL)
+		return ring;
+	ring = ecalloc(1, sizeof(Uring));
+	if (uring_init(ring, URING_DEPTH) < 0) {
+		log_to_file(__func__, __LINE__, "io_uring_setup: %s",
+			strerror(errno));
+		__atomic_store_n(&uring_broken, 1, __ATOMIC_RELAXED);
+		free(ring);
+		errno = 0;
+		return NULL;
+	}
+	pthread_setspecific(uring_key, ring);
+	return ring;
+}
+
+static int
+uring_stat_entries(Entry *entries, int count, int dirfd, int lazy)
+{
+	Uring *ring;
+	struct statx *bufs;
+	struct io_uring_sqe *sqe;
+	const struct io_uring_cqe *cqe;
+	Entry *ent;
+	int *slot_entry, *free_slots;
+	int nfree, inflight, next, slot, ret;
+	long submitted;
+	unsigned tail, head;
+
+	if ((ring = uring_get()) == NULL)
+		return -1;
+
+	bufs = ecalloc(ring->depth, sizeof(struct statx));
+	slot_entry = ecalloc(ring->depth, sizeof(int));
+	free_slots = ecalloc(ring->depth, sizeof(int));
+	for (nfree = 0; nfree < (int)ring->depth; nfree++)
+		free_slots[nfree] = nfree;
+
+	next = inflight = 0;
+	ret = 0;
+	while (next < count || inflight > 0) {
+		/* fill the submission queue with one statx per entry */
+		tail = *ring->sq_tail;
+		while (ret == 0 && nfree > 0 && next < count) {
+			if (entries[next].stated ||
+				(lazy && entries[next].mode != 0)) {
+				next++;
+				continue;
+			}
+			slot = free_slots[--nfree];
+			slot_entry[slot] = next;
+
+			sqe = &ring->sqes[tail & ring->sq_mask];
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode = IORING_OP_STATX;
+			sqe->fd = dirfd;
+			sqe->addr = (uintptr_t)entries[next].name;
+			sqe->len = STATX_FIELDS;
+			sqe->off = (uintptr_t)&bufs[slot];
+			sqe->statx_flags = statx_flags();
+			sqe->user_data = slot;
+			ring->sq_array[tail & ring->sq_mask] =
+				tail & ring->sq_mask;
+			tail++;
+			next++;
+		}
+		__atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+		head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+		if (tail == head && inflight == 0)
+			break;
+
+		submitted = syscall(__NR_io_uring_enter, ring->fd, tail - head,
+			1, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (submitted < 0) {
+			if (errno == EINTR)
+				continue;
+			log_to_file(__func__, __LINE__, "io_uring_enter: %s",
+				strerror(errno));
+			errno = 0;
+			ret = -1;
+			if (inflight == 0) {
+				/* take back the queue, the ring is reused */
+				tail = head;
+				__atomic_store_n(ring->sq_tail, tail,
+					__ATOMIC_RELEASE);
+				break;
+			}
+			continue;
+		}
+		inflight += submitted;
+
+		/* reap completions into the entry array */
+		head = *ring->cq_head;
+		while (head !=
+			__atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+			cqe = &ring->cqes[head & ring->cq_mask];
+			slot = (int)cqe->user_data;
+			ent = &entries[slot_entry[slot]];
+			if (cqe->res == 0) {
+				fill_entry_statx(ent, &bufs[slot]);
+			} else if (cqe->res == -EINVAL) {
+				/* no IORING_OP_STATX, leave it to the workers */
+				__atomic_store_n(&uring_broken, 1,
+					__ATOMIC_RELAXED);
+				ret = -1;
+			} else {
+				ent->stated = 1; /* removed since it was read */
+			}
+			free_slots[nfree++] = slot;
+			inflight--;
+			head++;
+		}
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	free(bufs);
+	free(slot_entry);
+	free(free_slots);
+	return ret;
+}
+#endif
+
+static void
+queue_stat(Pane *pane, Entry *ent)
+{
+	Loader *ld;
+	Entry *copy;
+
+	if (ent->stated || pane->dirfd < 0)
+		return;
+	if (pane->stat_next != NULL && pane->stat_next->all)
+		return;
+	if (stat_queued(pane->statter, ent->name) ||
+		stat_queued(pane->stat_next, ent->name))
+		return;
+
+	/* drawn from the d_type until the stat is back */
+	if (pane->stat_next == NULL)
+		pane->stat_next = new_loader(pane, pane->path);
+	ld = pane->stat_next;
+	if (ld->pending_count == STAT_QUEUE_MAX)
+		return;
+	if (ld->pending == NULL)
+		ld->pending = ecalloc(STAT_QUEUE_MAX, sizeof(Entry));
+	copy = &ld->pending[ld->pending_count++];
+	memset(copy, 0, sizeof(Entry));
+	copy->name = arena_strdup(&ld->pending_names, ent->name,
+		strnlen(ent->name, NAME_MAX));
+	copy->mode = ent->mode;
+}
+
+static int
+stat_queued(const Loader *ld, const char *name)
+{
+	int i;
+
+	if (ld == NULL)
+		return 0;
+	if (ld->all)
+		return 1;
+	for (i = 0; i < ld->pending_count; i++)
+		if (strncmp(ld->pending[i].name, name, NAME_MAX) == 0)
+			return 1;
+	return 0;
+}
+
+static void
+stat_all(Pane *pane)
+{
+	Loader *ld;
+	Entry *ent;
+	int i, n = 0;
+
+	/* an eager pane stats everything, lazy ones only what is shown */
+	if (lazy_stat || pane->slow || pane->dirfd < 0 ||
+		pane->window.offsets != NULL)
 		return;
-	}
-
-	dir = fdopendir(fd);
-	if (dir == NULL) {
-		close(fd);
-		print_status(color_err, strerror(errno));
+	if ((pane->statter != NULL && pane->statter->all) ||
+		(pane->stat_next != NULL && pane->stat_next->all))
+		return;
+	for (i = 0; i < pane->entry_count; i++)
+		n += pane->entries[i].stated == 0;
+	if (n == 0)
 		return;
-	}
 
-	pane->entry_count = 0;
-	while ((entry = readdir(dir)) != NULL) {
-		if (should_skip_entry(entry) == 0) {
-			pane->entry_count++;
-		}
+	/* the rows already waiting are part of it */
+	if (pane->stat_next != NULL)
+		free_loader(pane->stat_next);
+	ld = pane->stat_next = new_loader(pane, pane->path);
+	ld->all = 1;
+	ld->pending = ecalloc(n, sizeof(Entry));
+	for (i = 0; i < pane->entry_count; i++) {
+		if (pane->entries[i].stated)
+			continue;
+		ent = &ld->pending[ld->pending_count++];
+		ent->name = arena_strdup(&ld->pending_names,
+			pane->entries[i].name,
+			strnlen(pane->entries[i].name, NAME_MAX));
+		ent->mode = pane->entries[i].mode;
 	}
+}
 
-	pane->entries = ecalloc(pane->entry_count, sizeof(Entry));
-
-	rewinddir(dir);
-
-	i = 0;
-	while ((entry = readdir(dir)) != NULL) {
-		if (should_skip_entry(entry) == 1) {
+static void
+start_stats(void)
+{
+	Pane *pane;
+	Loader *ld;
+	sigset_t oldset;
+	int i, err;
+
+	/* one stat thread a pane, the next rows wait for it */
+	for (i = Left; i <= Right; i++) {
+		pane = &panes[i];
+		ld = pane->stat_next;
+		if (ld == NULL || pane->statter != NULL)
 			continue;
-		}
-		get_fullpath(tmpfull, pane->path, entry->d_name);
-
-		if (i >= pane->entry_count) {
-			log_to_file(__func__, __LINE__,
-				"Entry count exceeded allocated memory");
-			break;
-		}
-
-		// file deleted while getting its details
-		if (lstat(tmpfull, &status) != 0) {
-			log_to_file(__func__, __LINE__,
-				"lstat error for %s: %s", tmpfull,
-				strerror(errno));
-			memset(&pane->entries[i], 0, sizeof(Entry));
-			strncpy(pane->entries[i].fullpath, tmpfull,
-				PATH_MAX - 1);
-			strncpy(pane->entries[i].name, entry->d_name,
-				NAME_MAX - 1);
-			i++;
+		pane->stat_next = NULL;
+		if (strncmp(ld->path, pane->path, PATH_MAX) != 0 ||
+			pane->dirfd < 0 ||
+			(ld->dirfd = fcntl(pane->dirfd, F_DUPFD_CLOEXEC, 0)) <
+				0) {
+			free_loader(ld);
 			continue;
 		}
+		ld->restat = 1;
+
+		/* the thread inherits the blocked signals */
+		block_signals(&oldset);
+		err = pthread_create(&ld->thread, NULL, restat_worker, ld);
+		pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+		if (err != 0)
+			free_loader(ld);
+		else
+			pane->statter = ld;
+	}
+}
 
-		size_t fullpath_len = strlen(tmpfull);
-		size_t name_len = strlen(entry->d_name);
-
-		memcpy(pane->entries[i].fullpath, tmpfull, fullpath_len);
-		pane->entries[i].fullpath[fullpath_len] = '\0';
+static void *
+restat_worker(void *arg)
+{
+	Loader *ld = (Loader *)arg;
 
-		memcpy(pane->entries[i].name, entry->d_name, name_len);
-		pane->entries[i].name[name_len] = '\0';
+	/* a hung server holds this thread, never the keys */
+	stat_entries(ld->pending, ld->pending_count, ld->dirfd, 0);
+	finish_load(ld, 0);
+	return NULL;
+}
 
-		pane->entries[i].st = status;
+static int
+merge_stats(Pane *pane)
+{
+	Loader *ld = pane->statter;
+	Arena scratch = { NULL };
+	Entry *ent, *st;
+	int i, k, done, changed = 0;
 
-		set_entry_color(&pane->entries[pane->start_index + i]);
+	if (ld == NULL)
+		return 0;
+	pthread_mutex_lock(&ld->lock);
+	done = ld->done;
+	pthread_mutex_unlock(&ld->lock);
+	if (done == 0)
+		return 0;
 
-		i++;
+	pthread_join(ld->thread, NULL);
+	pane->statter = NULL;
+
+	/* the listing may have changed since, the names still hold */
+	if (strncmp(ld->path, pane->path, PATH_MAX) == 0) {
+		for (i = 0; i < ld->pending_count; i++) {
+			st = &ld->pending[i];
+			if ((k = entry_named(pane, st->name, &scratch)) < 0)
+				continue;
+			ent = &pane->entries[k];
+			ent->size = st->size;
+			ent->mtime = st->mtime;
+			ent->uid = st->uid;
+			ent->gid = st->gid;
+			ent->mode = st->mode;
+			ent->stated = 1;
+			set_entry_color(ent);
+			changed = 1;
+		}
 	}
-
-	pane->entry_count = i;
-
-	if (closedir(dir) < 0)
-		die("closedir:");
-	qsort(pane->entries, pane->entry_count, sizeof(Entry), entry_compare);
+	arena_free(&scratch);
+
+	/* orders by size or time were built before the sizes and times */
+	if (changed && ld->all) {
+		for (i = 0; i < SORT_MODES; i++) {
+			if (i % SortKeys != SortSize &&
+				i % SortKeys != SortTime)
+				continue;
+			free(pane->orders[i]);
+			pane->orders[i] = NULL;
+		}
+		if (sort_mode % SortKeys == SortSize ||
+			sort_mode % SortKeys == SortTime)
+			rebuild_view(pane);
+	}
+	free_loader(ld);
+	return changed;
 }
 
 static int
-should_skip_entry(const struct dirent *entry)
+should_skip_entry(const char *name, int dotfiles)
 {
-	if (entry->d_name[0] == '.') {
-		if (entry->d_name[1] == '\0' ||
-			(entry->d_name[1] == '.' && entry->d_name[2] == '\0'))
+	if (name[0] == '.') {
+		if (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))
 			return 1;
-		if (show_dotfiles != 1)
+		if (dotfiles != 1)
 			return 1;
 	}
 	return 0;
 }
 
+static void
+free_entries(Pane *pane)
+{
+	if (pane->dirfd >= 0) {
+		close(pane->dirfd);
+		pane->dirfd = -1;
+	}
+	free(pane->entries);
+	pane->entries = NULL;
+	free_orders(pane->orders);
+	pane->entry_count = 0;
+	free(pane->view);
+	pane->view = NULL;
+	pane->view_count = 0;
+	arena_free(&pane->names);
+	free(pane->window.offsets);
+	memset(&pane->window, 0, sizeof(Window));
+}
+
 static void
 get_fullpath(char *full_path, const char *first, const char *second)
 {
 	int ret;
 
 	if (first[0] == '/' && first[1] == '\0')
-		(void)snprintf(full_path, PATH_MAX, "/%s", second);
-
-	ret = snprintf(full_path, PATH_MAX, "%s/%s", first, second);
+		ret = snprintf(full_path, PATH_MAX, "/%s", second);
+	else
+		ret = snprintf(full_path, PATH_MAX, "%s/%s", first, second);
 	if (ret < 0)
 		die(strerror(errno));
 	if (ret >= PATH_MAX)
 		die("Path exceeded maximum length");
 }
 
+static char *
+get_entry_path(Pane *pane, Entry *ent)
+{
+	char *path;
+
+	path = ecalloc(PATH_MAX, sizeof(char));
+	get_fullpath(path, pane->path, ent->name);
+	return path;
+}
+
 static int
 get_selected_paths(Pane *pane, char **result)
 {
 	int count = 0;
 
-	for (int i = 0; i < pane->entry_count; i++) {
-		if (pane->entries[i].selected) {
-			result[count] = pane->entries[i].fullpath;
+	for (int i = 0; i < pane->view_count; i++) {
+		if (pane_entry(pane, i)->selected) {
+			result[count] =
+				get_entry_path(pane, pane_entry(pane, i));
 			count++;
 		}
 	}
@@ -354,6 +2932,16 @@ get_selected_paths(Pane *pane, char **result)
 	return count;
 }
 
+static void
+free_selected_entries(void)
+{
+	for (int i = 0; i < selected_count; i++)
+		free(selected_entries[i]);
+	free(selected_entries);
+	selected_entries = NULL;
+	selected_count = 0;
+}
+
 // static int
 // entry_compare(const void *const A, const void *const B)
 // {
@@ -373,49 +2961,58 @@ get_selected_paths(Pane *pane, char **result)
 // }
 
 static int
-entry_compare(const void *a, const void *b)
+entry_compare(const Entry *a, const Entry *b, int mode)
 {
-	const Entry *entryA = (const Entry *)a;
-	const Entry *entryB = (const Entry *)b;
+	mode_t type_a = a->mode & S_IFMT;
+	mode_t type_b = b->mode & S_IFMT;
+	int ret = 0;
 
-	if (!entryA || !entryB) {
-		return 0;
-	}
+	/* file type first, d_type gives the same order as a full stat */
+	if (type_a != type_b)
+		return type_a < type_b ? -1 : 1;
 
-	mode_t modeA = entryA->st.st_mode;
-	mode_t modeB = entryB->st.st_mode;
-
-	if (modeA < modeB) {
-		return -1;
-	} else if (modeA == modeB) {
-		return strncmp(entryA->name, entryB->name, NAME_MAX);
-	} else {
-		return 1;
+	switch (mode % SortKeys) {
+	case SortSize:
+		ret = (a->size > b->size) - (a->size < b->size);
+		break;
+	case SortTime:
+		ret = (a->mtime > b->mtime) - (a->mtime < b->mtime);
+		break;
+	case SortExt:
+		ret = strncmp(entry_ext(a), entry_ext(b), NAME_MAX);
+		break;
 	}
+	/* ties go by name, reversed only when sorting by name */
+	if (ret == 0)
+		ret = name_compare(a, b);
+	else if (mode >= SortKeys)
+		ret = -ret;
+	return mode == SortName + SortKeys ? -ret : ret;
 }
 
 static void
 update_screen(void)
 {
-	// clear all except last line
-	write(STDOUT_FILENO, "\x1b[F\x1b[A\x1b[999C\x1b[1J", 16);
+	redraw_pending = 0;
+	redraw_errno = 0;
+
+	write_entries_name();
 	append_entries(&panes[Left]);
 	append_entries(&panes[Right]);
-	termb_write();
-	write_entries_name();
 
-	log_to_file(__func__, __LINE__, "err: (%d)", errno);
 	if (mode == NormalMode && errno == 0)
 		display_entry_details();
 	else
-		print_status(color_err, strerror(errno));
+		put_status(color_err, strerror(errno));
 }
 
 static void
 disable_raw_mode(void)
 {
 	tcsetattr(STDIN_FILENO, TCSAFLUSH, &term.orig);
-	if (write(STDOUT_FILENO, "\x1b[?1049l", 8) < 0)
+	if (term.margins && write(STDOUT_FILENO, "\x1b[?69l", 6) < 0)
+		die("write:");
+	if (write(STDOUT_FILENO, "\x1b[0m\x1b[?1049l", 12) < 0)
 		die("write:");
 }
 
@@ -423,54 +3020,113 @@ static void
 append_entries(Pane *pane)
 {
 	int i;
-	int n = 0;
-	size_t index = 0;
-	size_t max_len = term.cols / 2;
-	Entry entry;
-	char *buffer;
 
-	if (pane->entries == NULL) {
+	for (i = 0; i < term.rows - 2; i++)
+		put_entry(pane, pane->start_index + i);
+}
+
+static void
+put_entry(Pane *pane, int index)
+{
+	int row = index - pane->start_index + 1;
+	int width = term.cols / 2;
+	Entry *ent;
+	ColorPair color;
+
+	if (row < 1 || row > term.rows - 2)
+		return;
+	if (pane->entries == NULL || index < 0 || index >= pane->view_count) {
+		fill_cells(row, pane->offset, width, &blank_cell);
 		return;
 	}
-	buffer = ecalloc(term.buffer_size, sizeof(char));
-	termb_append("\x1b[2;1f", 6); // move to top left
 
-	for (i = 0;
-		i < term.rows - 2 && pane->start_index + i < pane->entry_count;
-		i++) {
+	ent = pane_entry(pane, index);
+	queue_stat(pane, ent);
+	color = ent->color;
 
-		if (pane->start_index + i >= pane->entry_count ||
-			pane->entries == NULL) {
-			continue;
-		}
+	/* selected entry */
+	if (ent->selected == 1)
+		color = color_selected;
+
+	/* current entry */
+	if (pane == current_pane && index == pane->current_index)
+		color.attr |= RVS;
 
-		entry = pane->entries[pane->start_index + i];
+	memcpy(&term.cells[row * term.cols + pane->offset],
+		entry_line(ent, color), width * sizeof(Cell));
+	term.dirty = 1;
+}
 
-		/* selected entry */
-		if (entry.selected == 1)
-			entry.color = color_selected;
+static Cell *
+entry_line(Entry *ent, ColorPair color)
+{
+	Line *line = NULL;
+	int width = term.cols / 2;
+	int used;
+	int i;
 
-		/* current entry */
-		if (pane == current_pane &&
-			pane->start_index + i == pane->current_index) {
-			entry.color.attr |= RVS;
-		}
+	if (ent->line > 0 && ent->line <= lines_len &&
+		lines[ent->line - 1].name == ent->name)
+		line = &lines[ent->line - 1];
+
+	if (line == NULL) {
+		/* the slot claimed longest ago */
+		line = &lines[line_clock];
+		ent->line = line_clock + 1;
+		line_clock = (line_clock + 1) % lines_len;
+
+		used = layout_text(line->cells, width, ent->name, color);
+		for (i = used; i < width; i++)
+			line->cells[i] = (Cell) { " ", 1, 1, 0, color };
+		line->name = ent->name;
+		line->color = color;
+	} else if (memcmp(&line->color, &color, sizeof(color)) != 0) {
+		/* selection, cursor and search only change the colors */
+		for (i = 0; i < width; i++)
+			line->cells[i].color = color;
+		line->color = color;
+	}
 
-		// Format the entry with truncation and padding
-		n = snprintf(buffer + index, term.buffer_size - index,
-			"\x1b[%dG"
-			"\x1b[%d;38;5;%d;48;5;%dm%-*.*s\x1b[0m\r\n",
-			pane->offset, entry.color.attr, entry.color.fg,
-			entry.color.bg, (int)max_len, (int)max_len, entry.name);
-		if (n < 0)
-			break;
+	return line->cells;
+}
 
-		index += n;
+static int
+read_sequence(void)
+{
+	struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+	char seq[32];
+	size_t len = 0;
+	int c;
+
+	/* an escape alone is a key, bytes right behind it are not */
+	if (poll(&pfd, 1, 0) <= 0)
+		return 0;
+	if ((c = getchar()) != '[') {
+		handle_keypress(XK_ESC);
+		if (c != EOF)
+			handle_keypress(c);
+		return 1;
 	}
 
-	termb_append(buffer, index);
-	free(buffer);
-	buffer = NULL;
+	do {
+		if (poll(&pfd, 1, SEQUENCE_WAIT) <= 0 || (c = getchar()) == EOF)
+			break;
+		seq[len++] = c;
+	} while ((c < 0x40 || c > 0x7e) && len < sizeof(seq) - 1);
+	seq[len] = '\0';
+
+	if (strcmp(seq, "?69;1$y") == 0 || strcmp(seq, "?69;2$y") == 0) {
+		/* left and right margins, to scroll one pane */
+		if (write(STDOUT_FILENO, "\x1b[?69h", 6) < 0)
+			die("write:");
+		term.margins = 1;
+	} else if (len > 0 && len <= 2) {
+		/* keys, packed like XK_UP */
+		grabkeys(XK_ESC | '[' << 8 | (uint8_t)seq[0] << 16 |
+				(uint32_t)(uint8_t)seq[1] << 24,
+			nkeys, nkeyslen);
+	}
+	return 1;
 }
 
 static void
@@ -497,30 +3153,25 @@ grabkeys(uint32_t k, Key *key, size_t max_keys)
 static void
 print_status(ColorPair color, const char *fmt, ...)
 {
-	char buf[term.cols];
-	int buf_len;
-	size_t max_result_size;
-	size_t result_len;
+	char buf[term.cols * 4 + 1];
 	va_list vl;
 
 	va_start(vl, fmt);
-	buf_len = vsnprintf(buf, term.cols, fmt, vl);
+	vsnprintf(buf, sizeof(buf), fmt, vl);
 	va_end(vl);
+	put_status(color, buf);
+}
 
-	max_result_size = 5 + UINT16_LEN + 4 + 15 + UINT8_LEN + UINT8_LEN +
-		UINT8_LEN + buf_len + 6 + 1;
-
-	char result[max_result_size];
-	result_len = snprintf(result, max_result_size,
-		"\x1b[%d;1f" // moves cursor to last line, column 1
-		"\x1b[2K"    // erase the entire line
-		"\x1b[%d;38;5;%d;48;5;%dm" // set string colors
-		"%s"
-		"\x1b[0;0m", // reset colors
-		term.rows, color.attr, color.fg, color.bg, buf);
+static void
+put_status(ColorPair color, const char *text)
+{
+	int used;
 
-	if (write(STDOUT_FILENO, result, result_len) < 0)
-		die("write:");
+	/* the cursor rests after the text, on the screen */
+	used = put_text(term.rows - 1, 0, term.cols - 1, text, color);
+	fill_cells(term.rows - 1, used, term.cols - used, &blank_cell);
+	term.park_row = term.rows - 1;
+	term.park_col = used;
 }
 
 static void
@@ -531,29 +3182,73 @@ display_entry_details(void)
 	char gr[GROUP_MAX];
 	char dt[DATETIME_MAX];
 	char prm[PERMISSION_MAX];
-	struct stat st;
+	char note[48];
+	char status[256];
+	char *end = note + sizeof(note) - 1;
+	char *p = note;
+	Entry *ent;
+
+	if (current_pane != NULL && current_pane->loader != NULL &&
+		current_pane->loader->swapped == 0) {
+		p = encode_str(p, end, "  loading...", NULL);
+	} else if (current_pane != NULL && current_pane->loader != NULL) {
+		p = encode_str(p, end, "  loading ", NULL);
+		p = encode_uint(p, current_pane->window.total, 1);
+		p = encode_str(p, end, " entries...", NULL);
+	} else if (current_pane != NULL &&
+		current_pane->window.offsets != NULL) {
+		p = encode_str(p, end, "  unsorted", NULL);
+	} else if (sort_mode != SortName) {
+		p = encode_str(p, end, "  by ",
+			sort_names[sort_mode % SortKeys],
+			sort_mode >= SortKeys ? ", reversed" : "", NULL);
+	}
+	*p = '\0';
 
 	if (current_pane == NULL || current_pane->entries == NULL ||
-		current_pane->entry_count < 1) {
-		print_status(color_warn, "Empty directory.");
+		current_pane->view_count < 1) {
+		if (note[0] != '\0')
+			put_status(color_warn, note + 2);
+		else
+			put_status(color_warn, "Empty directory.");
 		return;
 	}
 
-	if (current_pane->current_index >= current_pane->entry_count) {
+	/* past the window shown while the next one is read */
+	if (current_pane->current_index < 0 ||
+		current_pane->current_index >= current_pane->view_count) {
 		return;
 	}
 
-	st = current_pane->entries[current_pane->current_index].st;
-
-	get_entry_permission(prm, st.st_mode);
-	get_entry_owner(ur, st.st_uid);
-	get_entry_group(gr, st.st_gid);
-	get_entry_datetime(dt, st.M_TIME.tv_sec);
-	get_file_size(sz, st.st_size);
+	ent = pane_entry(current_pane, current_pane->current_index);
+	queue_stat(current_pane, ent);
+
+	end = status + sizeof(status) - 1;
+	p = encode_uint(status, current_pane->window.first +
+		current_pane->current_index + 1, 2);
+	*p++ = '/';
+	p = encode_uint(p, pane_total(current_pane), 2);
+	if (ent->stated == 0) {
+		/* no owner, time or size until its stat is back */
+		p = encode_str(p, end, "  ", current_pane->fstype, " ",
+			lazy_stat || current_pane->slow ? "lazy" : "eager",
+			note, NULL);
+		*p = '\0';
+		put_status(color_status, status);
+		return;
+	}
 
-	print_status(color_status, "%02d/%02d %s %s:%s %s %s",
-		current_pane->current_index + 1, current_pane->entry_count, prm,
-		ur, gr, dt, sz);
+	get_entry_permission(prm, ent->mode);
+	get_entry_owner(ur, ent->uid);
+	get_entry_group(gr, ent->gid);
+	get_entry_datetime(dt, ent->mtime);
+	get_file_size(sz, ent->size);
+
+	p = encode_str(p, end, " ", prm, " ", ur, ":", gr, " ", dt, " ", sz,
+		"  ", current_pane->fstype, " ",
+		lazy_stat || current_pane->slow ? "lazy" : "eager", note, NULL);
+	*p = '\0';
+	put_status(color_status, status);
 }
 
 static void
@@ -567,10 +3262,10 @@ set_entry_color(Entry *ent)
 		return;
 	}
 
-	switch (ent->st.st_mode & S_IFMT) {
+	switch (ent->mode & S_IFMT) {
 	case S_IFREG:
 		ent->color = color_file;
-		if ((S_IXUSR | S_IXGRP | S_IXOTH) & ent->st.st_mode)
+		if ((S_IXUSR | S_IXGRP | S_IXOTH) & ent->mode)
 			ent->color = color_exec;
 		break;
 	case S_IFDIR:
@@ -666,8 +3361,9 @@ get_file_size(char *buf, off_t size)
 		unit = '?';
 	}
 
-	if (snprintf(buf, FSIZE_MAX, OFF_T "%c", size, unit) < 0)
-		print_status(color_err, strerror(errno));
+	buf = encode_uint(buf, size, 1);
+	buf[0] = unit;
+	buf[1] = '\0';
 }
 
 static void
@@ -677,7 +3373,7 @@ get_entry_owner(char *buf, const uid_t uid)
 
 	pw = getpwuid(uid);
 	if (pw == NULL) {
-		snprintf(buf, USER_MAX, "%u", uid);
+		*encode_uint(buf, uid, 1) = '\0';
 	} else {
 		strncpy(buf, pw->pw_name, USER_MAX - 1);
 		buf[GROUP_MAX - 1] = '\0';
@@ -691,7 +3387,7 @@ get_entry_group(char *buf, const gid_t gid)
 
 	gr = getgrgid(gid);
 	if (gr == NULL) {
-		snprintf(buf, GROUP_MAX, "%u", gid);
+		*encode_uint(buf, gid, 1) = '\0';
 	} else {
 		strncpy(buf, gr->gr_name, GROUP_MAX - 1);
 		buf[GROUP_MAX - 1] = '\0';
@@ -708,10 +3404,12 @@ get_user_input(char *input, size_t size, const char *prompt, ...)
 
 	va_start(args, prompt);
 	vsnprintf(msg, PROMPT_MAX, prompt, args);
-	print_status(color_normal, msg);
 	va_end(args);
 
+	input[0] = '\0';
 	while (1) {
+		print_status(color_normal, "%s%s", msg, input);
+		flush_cells(); /* the main loop is not drawing */
 		c = getchar();
 
 		switch (c) {
@@ -723,15 +3421,13 @@ get_user_input(char *input, size_t size, const char *prompt, ...)
 			//display_entry_details();
 			return 0;
 		case XK_BACKSPACE:
-			if (index > 0) {
-				index--;
-				printf("\b \b");
-			}
+			if (index > 0)
+				input[--index] = '\0';
 			break;
 		default:
 			if (index < size - 1) {
 				input[index++] = c;
-				putchar(c);
+				input[index] = '\0';
 			}
 			break;
 		}
@@ -985,52 +3681,514 @@ execute_command(Command *cmd)
 
 static void
 termb_append(const char *str, size_t len)
+{
+	memcpy(termb_room(len), str, len);
+	term.buffer_index += len;
+	term.buffer_left = term.buffer_size - term.buffer_index;
+}
+
+static char *
+termb_room(size_t len)
 {
 	if (len >= term.buffer_left) {
-		term.buffer = erealloc(term.buffer, term.buffer_size * 2);
-		term.buffer_size *= 2;
+		term.buffer_size = MAX(term.buffer_size * 2,
+			term.buffer_index + len + 1);
+		term.buffer = erealloc(term.buffer, term.buffer_size);
+		term.buffer_left = term.buffer_size - term.buffer_index;
+	}
+	return &term.buffer[term.buffer_index];
+}
+
+static void
+termb_csi(int a, int b, char final)
+{
+	char *start = termb_room(2 * UINT32_LEN + 4);
+	char *p = start;
+
+	/* ESC [ a ; b final, without the parameters below 0 */
+	*p++ = '\x1b';
+	*p++ = '[';
+	if (a >= 0)
+		p = encode_uint(p, a, 1);
+	if (b >= 0) {
+		*p++ = ';';
+		p = encode_uint(p, b, 1);
+	}
+	*p++ = final;
+	term.buffer_index += p - start;
+	term.buffer_left = term.buffer_size - term.buffer_index;
+}
+
+static char *
+encode_uint(char *p, unsigned long n, int digits)
+{
+	char tmp[UINT64_LEN];
+	int len = 0;
+
+	do {
+		tmp[len++] = '0' + n % 10;
+		n /= 10;
+	} while (n > 0);
+	while (digits-- > len)
+		*p++ = '0';
+	while (len > 0)
+		*p++ = tmp[--len];
+	return p;
+}
+
+static char *
+encode_str(char *p, const char *end, ...)
+{
+	const char *s;
+	va_list ap;
+
+	/* copies strings up to a NULL, as many bytes as fit before end */
+	va_start(ap, end);
+	while ((s = va_arg(ap, const char *)) != NULL)
+		while (*s != '\0' && p < end)
+			*p++ = *s++;
+	va_end(ap);
+	return p;
+}
+
+static void
+termb_write(void)
+{
+	ssize_t done = 0;
+	ssize_t n;
+
+	while (done < term.buffer_index) {
+		n = write(STDOUT_FILENO, term.buffer + done,
+			term.buffer_index - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			die("write:");
+		done += n;
+	}
+	term.buffer_index = 0;
+	term.buffer_left = term.buffer_size;
+}
+
+static void
+write_entries_name(void)
+{
+	int half_cols = term.cols / 2;
+
+	put_line(0, 0, half_cols, panes[Left].path, color_panell);
+	put_line(0, half_cols, half_cols, panes[Right].path, color_panelr);
+}
+
+static void
+termb_resize(void)
+{
+	resize_pending = 0;
+	get_term_size();
+	resize_cells();
+	panes[Right].offset = term.cols / 2;
+	schedule_redraw();
+}
+
+static void
+resize_cells(void)
+{
+	size_t n = (size_t)MAX(term.rows, 1) * MAX(term.cols, 1);
+	size_t i;
+	int len;
+
+	if (n != term.cells_len) {
+		free(term.cells);
+		free(term.shown);
+		term.cells = ecalloc(n, sizeof(Cell));
+		term.shown = ecalloc(n, sizeof(Cell));
+		term.cells_len = n;
+	}
+	/* rows drawn for either pane, redrawn on a new width */
+	len = MIN(LINES_PER_ROW * MAX(term.rows, 2), UINT16_MAX);
+	if (lines_width != term.cols / 2 || lines_len != len) {
+		free_lines();
+		lines_width = term.cols / 2;
+		lines_len = len;
+		lines = ecalloc(lines_len, sizeof(Line));
+		line_cells = ecalloc((size_t)lines_len * MAX(lines_width, 1),
+			sizeof(Cell));
+		for (i = 0; i < (size_t)lines_len; i++)
+			lines[i].cells = &line_cells[i * MAX(lines_width, 1)];
+	}
+	for (i = 0; i < n; i++)
+		term.cells[i] = blank_cell;
+	termb_room(n * 8); /* a whole frame, kept from then on */
+	term.park_row = term.rows - 1;
+	term.park_col = 0;
+	term.clear = 1; /* nothing on the screen is known */
+	term.dirty = 1;
+}
+
+static void
+free_lines(void)
+{
+	free(lines);
+	free(line_cells);
+	lines = NULL;
+	line_cells = NULL;
+	lines_len = 0;
+	line_clock = 0;
+}
+
+static int
+decode_glyph(const char *str, Cell *cell)
+{
+	const unsigned char *s = (const unsigned char *)str;
+	uint32_t cp = s[0];
+	int len = 1;
+	int width;
+	int i;
+
+	memset(cell, 0, sizeof(*cell));
+	if (s[0] >= 0xf0 && s[0] < 0xf8) {
+		len = 4;
+		cp = s[0] & 0x07;
+	} else if (s[0] >= 0xe0 && s[0] < 0xf0) {
+		len = 3;
+		cp = s[0] & 0x0f;
+	} else if (s[0] >= 0xc2 && s[0] < 0xe0) {
+		len = 2;
+		cp = s[0] & 0x1f;
+	} else if (s[0] >= 0x80) {
+		len = 0;
+	}
+	for (i = 1; i < len; i++) {
+		if ((s[i] & 0xc0) != 0x80) {
+			len = 0;
+			break;
+		}
+		cp = cp << 6 | (s[i] & 0x3f);
+	}
+
+	width = len > 0 ? wcwidth((wchar_t)cp) : -1;
+	if (width < 0 && len > 1 && cp >= 0xa0)
+		width = 1; /* a locale that does not know it */
+	if (width < 0) {
+		/* control characters and broken sequences */
+		cell->glyph[0] = '?';
+		cell->len = 1;
+		cell->width = 1;
+		return len > 0 ? len : 1;
+	}
+
+	memcpy(cell->glyph, s, len);
+	cell->len = len;
+	cell->width = width;
+	return len;
+}
+
+static int
+put_text(int row, int col, int width, const char *str, ColorPair color)
+{
+	if (row < 0 || row >= term.rows || col < 0)
+		return 0;
+	term.dirty = 1;
+	return layout_text(&term.cells[row * term.cols + col],
+		MIN(width, term.cols - col), str, color);
+}
+
+static int
+layout_text(Cell *line, int width, const char *str, ColorPair color)
+{
+	Cell *last = NULL;
+	Cell glyph;
+	int used = 0;
+
+	while (*str != '\0' && used < width) {
+		str += decode_glyph(str, &glyph);
+		if (glyph.width == 0) {
+			/* combining marks go with the glyph before them */
+			if (last != NULL &&
+				last->len + glyph.len <= sizeof(last->glyph)) {
+				memcpy(last->glyph + last->len, glyph.glyph,
+					glyph.len);
+				last->len += glyph.len;
+			}
+			continue;
+		}
+		if (used + glyph.width > width)
+			break;
+
+		glyph.color = color;
+		last = &line[used];
+		line[used++] = glyph;
+		if (glyph.width == 2) {
+			/* the right half is never drawn on its own */
+			memset(&line[used], 0, sizeof(Cell));
+			line[used++].color = color;
+		}
+	}
+
+	return used;
+}
+
+static void
+put_line(int row, int col, int width, const char *str, ColorPair color)
+{
+	int used;
+
+	used = put_text(row, col, width, str, color);
+	fill_cells(row, col + used, width - used,
+		&(Cell) { " ", 1, 1, 0, color });
+}
+
+static void
+fill_cells(int row, int col, int width, const Cell *cell)
+{
+	Cell *line;
+	int i;
+
+	if (row < 0 || row >= term.rows || col < 0)
+		return;
+	width = MIN(width, term.cols - col);
+	line = &term.cells[row * term.cols + col];
+	term.dirty = 1;
+	for (i = 0; i < width; i++)
+		line[i] = *cell;
+}
+
+static int
+num_len(int n)
+{
+	int len = 1;
+
+	while (n >= 10) {
+		n /= 10;
+		len++;
+	}
+	return len;
+}
+
+static int
+same_pen(const Cell *a, const Cell *b)
+{
+	if (a->plain || b->plain)
+		return a->plain == b->plain;
+	return memcmp(&a->color, &b->color, sizeof(a->color)) == 0;
+}
+
+static void
+move_to(int row, int col)
+{
+	Cell *shown;
+	int gap = col - term.cur_col;
+	int cost = 0;
+	int i;
+
+	if (term.cur_row == row && gap == 0)
+		return;
+
+	if (term.cur_row == row && gap > 0) {
+		/* printing what is shown again may be shorter */
+		shown = &term.shown[row * term.cols + term.cur_col];
+		for (i = 0; i < gap && cost >= 0; i++) {
+			if (shown[i].width != 1 ||
+				!same_pen(&shown[i], &term.pen))
+				cost = -1;
+			else
+				cost += shown[i].len;
+		}
+		if (cost >= 0 && cost <= (gap == 1 ? 3 : 3 + num_len(gap))) {
+			for (i = 0; i < gap; i++)
+				termb_append(shown[i].glyph, shown[i].len);
+		} else {
+			termb_csi(gap == 1 ? -1 : gap, -1, 'C');
+		}
+	} else if (term.cur_row == row && col == 0) {
+		termb_append("\r", 1);
+	} else if (term.cur_row == row) {
+		termb_csi(col + 1, -1, 'G');
+	} else if (term.cur_row >= 0 && row == term.cur_row + 1 && col == 0) {
+		termb_append("\r\n", 2);
+	} else if (term.cur_row >= 0 && row == term.cur_row + 1 && gap == 0) {
+		termb_append("\n", 1);
+	} else {
+		termb_csi(row + 1, col == 0 ? -1 : col + 1, 'H');
+	}
+
+	term.cur_row = row;
+	term.cur_col = col;
+}
+
+static void
+set_pen(const Cell *cell)
+{
+	const ColorPair *pen = &term.pen.color;
+	const ColorPair *color = &cell->color;
+	int reset = term.pen.plain || pen->attr != color->attr;
+	char *start;
+	char *p;
+
+	if (same_pen(cell, &term.pen))
+		return;
+	if (cell->plain) {
+		termb_append("\x1b[0m", 4);
+		term.pen.plain = 1;
+		return;
+	}
+
+	start = termb_room(2 * UINT8_LEN + 24);
+	p = start;
+	*p++ = '\x1b';
+	*p++ = '[';
+	if (reset) {
+		/* attributes only go away with a reset */
+		if (!term.pen.plain) {
+			*p++ = '0';
+			*p++ = ';';
+		}
+		if (color->attr != 0) {
+			p = encode_uint(p, color->attr, 1);
+			*p++ = ';';
+		}
 	}
-
-	memcpy(&term.buffer[term.buffer_index], str, len);
-	term.buffer_index += len;
+	if (reset || pen->fg != color->fg) {
+		memcpy(p, "38;5;", 5);
+		p = encode_uint(p + 5, color->fg, 1);
+		*p++ = ';';
+	}
+	if (reset || pen->bg != color->bg) {
+		memcpy(p, "48;5;", 5);
+		p = encode_uint(p + 5, color->bg, 1);
+		*p++ = ';';
+	}
+	p[-1] = 'm'; /* over the last separator */
+	term.buffer_index += p - start;
 	term.buffer_left = term.buffer_size - term.buffer_index;
+
+	term.pen.plain = 0;
+	term.pen.color = *color;
 }
 
 static void
-termb_write(void)
+termb_begin(void)
 {
-	if (write(STDOUT_FILENO, term.buffer, term.buffer_index - 1) < 0)
-		die("write:");
-	term.buffer_index = 0;
-	term.buffer_left = term.buffer_size;
+	/* the terminal shows none of a frame before all of it is in */
+	if (term.buffer_index == 0 && sync_output)
+		termb_append(SYNC_BEGIN, LEN(SYNC_BEGIN) - 1);
 }
 
 static void
-write_entries_name(void)
+scroll_cells(int top, int rows, int left, int cols, int n)
 {
-	int half_cols = term.cols / 2;
-	char result[term.cols + 100];
+	Cell *line;
+	int row;
+	int from;
+	int i;
 
-	int result_len = snprintf(result, sizeof(result),
-		"\x1b[1;1H"                // Move cursor to top-left corner
-		"\x1b[%d;38;5;%d;48;5;%dm" // Set colors for left pane
-		"%-*.*s"                   // Left string with padding
-		"\x1b[%d;38;5;%d;48;5;%dm" // Set colors for right pane
-		"%-*.*s"                   // Right string with padding
-		"\x1b[0m",                 // Reset colors
-		color_panell.attr, color_panell.fg, color_panell.bg, half_cols,
-		half_cols, panes[Left].path, color_panelr.attr, color_panelr.fg,
-		color_panelr.bg, half_cols, half_cols, panes[Right].path);
+	if (!term.margins || term.clear || n == 0 || abs(n) >= rows ||
+		top + rows > term.rows || left + cols > term.cols)
+		return;
 
-	write(STDOUT_FILENO, result, result_len);
+	/* what scrolls in is blank in the default colors */
+	termb_begin();
+	set_pen(&blank_cell);
+	termb_csi(top + 1, top + rows, 'r');
+	termb_csi(left + 1, left + cols, 's');
+	termb_csi(abs(n) == 1 ? -1 : abs(n), -1, n > 0 ? 'S' : 'T');
+	termb_append("\x1b[r\x1b[s", 6); /* margins off, cursor home */
+	term.cur_row = 0;
+	term.cur_col = 0;
+
+	/* the same on what the terminal shows */
+	for (i = 0; i < rows; i++) {
+		row = n > 0 ? top + i : top + rows - 1 - i;
+		from = row + n;
+		line = &term.shown[row * term.cols + left];
+		if (from >= top && from < top + rows) {
+			memcpy(line, &term.shown[from * term.cols + left],
+				cols * sizeof(Cell));
+		} else {
+			for (from = 0; from < cols; from++)
+				line[from] = blank_cell;
+		}
+	}
+	term.dirty = 1;
 }
 
 static void
-termb_resize(void)
+flush_cells(void)
 {
-	termb_append("\033[2J", 4);
-	get_term_size();
-	update_screen();
+	Cell *next;
+	Cell *shown;
+	int row;
+	int col;
+	int end;
+	int i;
+	ssize_t begin;
+
+	if (!term.dirty)
+		return;
+	term.dirty = 0;
+
+	termb_begin();
+	begin = sync_output ? (ssize_t)LEN(SYNC_BEGIN) - 1 : 0;
+
+	if (term.clear) {
+		termb_append("\x1b[0m\x1b[2J", 8);
+		for (i = 0; i < term.rows * term.cols; i++)
+			term.shown[i] = blank_cell;
+		term.pen = blank_cell;
+		term.cur_row = -1;
+		term.clear = 0;
+	}
+
+	for (row = 0; row < term.rows; row++) {
+		next = &term.cells[row * term.cols];
+		shown = &term.shown[row * term.cols];
+		if (memcmp(next, shown, term.cols * sizeof(Cell)) == 0)
+			continue;
+
+		/* plain blanks up to the end of the row are one erase */
+		for (end = term.cols; end > 0 &&
+			memcmp(&next[end - 1], &blank_cell, sizeof(Cell)) == 0;
+			end--)
+			;
+
+		col = 0;
+		while (col < term.cols) {
+			if (memcmp(next + col, shown + col,
+				sizeof(Cell)) == 0) {
+				col++;
+				continue;
+			}
+			if (next[col].len == 0 && col > 0)
+				col--; /* the right half of a wide glyph */
+
+			move_to(row, col);
+			if (col >= end && term.cols - col > 3) {
+				set_pen(&blank_cell);
+				termb_append("\x1b[K", 3);
+				memcpy(&shown[col], &next[col],
+					(term.cols - col) * sizeof(Cell));
+				break;
+			}
+
+			set_pen(&next[col]);
+			termb_append(next[col].glyph, next[col].len);
+			shown[col] = next[col];
+			if (next[col].width == 2) {
+				shown[col + 1] = next[col + 1];
+			}
+			col += MAX(next[col].width, 1);
+			term.cur_col = col;
+			if (col >= term.cols)
+				term.cur_row = -1; /* the wrap is pending */
+		}
+	}
+
+	if (term.park_row >= 0)
+		move_to(term.park_row, term.park_col);
+	if (term.buffer_index == begin)
+		term.buffer_index = 0; /* nothing changed */
+	else if (sync_output)
+		termb_append(SYNC_END, LEN(SYNC_END) - 1);
+	termb_write(); /* one write a frame */
 }
 
 static void
@@ -1039,10 +4197,12 @@ cd_to_parent(const Arg *arg)
 	char parent_path[PATH_MAX];
 	char *last_slash;
 
-	if (current_pane->path[0] == '/' && current_pane->path[1] == '\0')
+	/* from a directory still loading, go to its parent */
+	strncpy(parent_path, target_path(current_pane), PATH_MAX - 1);
+	parent_path[PATH_MAX - 1] = '\0';
+	if (parent_path[0] == '/' && parent_path[1] == '\0')
 		return;
 
-	strncpy(parent_path, current_pane->path, PATH_MAX);
 	last_slash = strrchr(parent_path, '/');
 	if (last_slash != NULL)
 		*last_slash = '\0';
@@ -1051,14 +4211,7 @@ cd_to_parent(const Arg *arg)
 		strncpy(parent_path, "/", PATH_MAX);
 	}
 
-	strncpy(current_pane->path, parent_path, PATH_MAX);
-
-	remove_watch(current_pane);
-	set_pane_entries(current_pane);
-	add_watch(current_pane);
-
-	current_pane->current_index = 0;
-	current_pane->start_index = 0;
+	set_pane_entries(current_pane, parent_path);
 	update_screen();
 }
 
@@ -1102,13 +4255,19 @@ create_new_dir(const Arg *arg)
 static void
 copy_entries(const Arg *arg)
 {
-	selected_entries = ecalloc(current_pane->entry_count, sizeof(char *));
+	if (current_pane->view_count < 1) {
+		print_status(color_warn, "No entries selected.");
+		return;
+	}
+
+	free_selected_entries();
+	selected_entries = ecalloc(current_pane->view_count, sizeof(char *));
 	selected_count = get_selected_paths(current_pane, selected_entries);
 
-	if (selected_count < 1) {
-		selected_entries[0] =
-			current_pane->entries[current_pane->current_index]
-				.fullpath;
+	if (selected_count < 1 && current_pane->current_index >= 0 &&
+		current_pane->current_index < current_pane->view_count) {
+		selected_entries[0] = get_entry_path(current_pane,
+			pane_entry(current_pane, current_pane->current_index));
 		selected_count = 1;
 	}
 
@@ -1127,19 +4286,19 @@ delete_entry(const Arg *arg)
 	Command cmd;
 	char confirmation[4];
 
-	if (current_pane->entry_count <= 0 ||
-		current_pane->current_index >= current_pane->entry_count) {
+	if (current_pane->view_count <= 0 || current_pane->current_index < 0 ||
+		current_pane->current_index >= current_pane->view_count) {
 		print_status(color_err, "No entry selected or invalid index.");
 		return;
 	}
 
-	selected_entries = ecalloc(current_pane->entry_count, sizeof(char *));
+	free_selected_entries();
+	selected_entries = ecalloc(current_pane->view_count, sizeof(char *));
 	selected_count = get_selected_paths(current_pane, selected_entries);
 
 	if (selected_count < 1) {
-		selected_entries[0] =
-			current_pane->entries[current_pane->current_index]
-				.fullpath;
+		selected_entries[0] = get_entry_path(current_pane,
+			pane_entry(current_pane, current_pane->current_index));
 		selected_count = 1;
 	}
 
@@ -1149,16 +4308,12 @@ delete_entry(const Arg *arg)
 	/* confirmation */
 	if (get_user_input(confirmation, sizeof(confirmation), "Delete (%s)?",
 		    delconf) < 0) {
-		free(selected_entries);
-		selected_entries = NULL;
-		selected_count = 0;
+		free_selected_entries();
 		return;
 	}
 	if (strncmp(confirmation, delconf, delconf_len) != 0) {
 		print_status(color_warn, "Deletion aborted.");
-		free(selected_entries);
-		selected_entries = NULL;
-		selected_count = 0;
+		free_selected_entries();
 		return;
 	}
 
@@ -1170,56 +4325,31 @@ delete_entry(const Arg *arg)
 
 	spawn(&cmd);
 
-	free(selected_entries);
-	selected_entries = NULL;
-	selected_count = 0;
+	free_selected_entries();
 	mode = NormalMode;
 }
 
 static void
 move_bottom(const Arg *arg)
 {
-	current_pane->current_index = current_pane->entry_count - 1;
-	current_pane->start_index = current_pane->entry_count - (term.rows - 2);
-	if (current_pane->start_index < 0) {
-		current_pane->start_index = 0;
+	int last = pane_total(current_pane) - current_pane->window.first;
+
+	current_pane->current_index = last - 1;
+	current_pane->start_index = last - (term.rows - 2);
+	if (current_pane->start_index < -current_pane->window.first) {
+		current_pane->start_index = -current_pane->window.first;
 	}
+	fit_window(current_pane);
 	update_screen();
 }
 
 static void
 update_entry(Pane *pane, int index)
 {
-	int err;
-	size_t max_len;
-	Entry entry;
-	char buffer[PATH_MAX];
-	int pos;
-
-	if (index < 0 || index >= pane->entry_count)
+	if (index < 0 || index >= pane->view_count)
 		return;
 
-	max_len = term.cols / 2;
-	entry = pane->entries[index];
-	pos = index - pane->start_index;
-
-	if (pane->entries[index].selected == 1)
-		entry.color = color_selected;
-
-	if (pane == current_pane && index == current_pane->current_index) {
-		entry.color.attr |= RVS;
-	}
-
-	err = snprintf(buffer, sizeof(buffer),
-		"\x1b[%d;%dH" // Move cursor to the entry position
-		"\x1b[%d;38;5;%d;48;5;%dm%-*.*s\x1b[0m",
-		pos + 2, pane->offset, entry.color.attr, entry.color.fg,
-		entry.color.bg, (int)max_len - 1, (int)max_len, entry.name);
-
-	if (err < 0)
-		print_status(color_err, strerror(errno));
-
-	write(STDOUT_FILENO, buffer, strlen(buffer));
+	put_entry(pane, index);
 }
 
 static void
@@ -1227,17 +4357,22 @@ move_cursor(const Arg *arg)
 {
 	int new_start_index;
 	int old_index;
+	int first;
 
-	if (current_pane->entry_count == 0)
+	if (current_pane->view_count == 0)
 		return;
 
 	old_index = current_pane->current_index;
 	current_pane->current_index += arg->i;
 
-	if (current_pane->current_index < 0) {
-		current_pane->current_index = 0;
-	} else if (current_pane->current_index >= current_pane->entry_count) {
-		current_pane->current_index = current_pane->entry_count - 1;
+	/* a window may reach past its own entries */
+	first = current_pane->window.first;
+	if (current_pane->current_index < -first) {
+		current_pane->current_index = -first;
+	} else if (current_pane->current_index >=
+		pane_total(current_pane) - first) {
+		current_pane->current_index =
+			pane_total(current_pane) - first - 1;
 	}
 
 	new_start_index = current_pane->start_index;
@@ -1248,8 +4383,15 @@ move_cursor(const Arg *arg)
 		current_pane->start_index =
 			current_pane->current_index - (term.rows - 3);
 	}
-
-	if (new_start_index != current_pane->start_index) {
+	fit_window(current_pane);
+
+	if (new_start_index != current_pane->start_index ||
+		first != current_pane->window.first) {
+		/* rows still shown move on the terminal itself */
+		if (first == current_pane->window.first)
+			scroll_cells(1, term.rows - 2, current_pane->offset,
+				term.cols / 2,
+				current_pane->start_index - new_start_index);
 		update_screen();
 	} else {
 		// Update only the necessary entries
@@ -1266,8 +4408,9 @@ move_cursor(const Arg *arg)
 static void
 move_top(const Arg *arg)
 {
-	current_pane->current_index = 0;
-	current_pane->start_index = 0;
+	current_pane->current_index = -current_pane->window.first;
+	current_pane->start_index = -current_pane->window.first;
+	fit_window(current_pane);
 	update_screen();
 }
 
@@ -1298,9 +4441,7 @@ move_entries(const Arg *arg)
 	spawn(&cmd);
 	print_status(color_normal, "Moved...");
 
-	free(selected_entries);
-	selected_entries = NULL;
-	selected_count = 0;
+	free_selected_entries();
 	free(argv);
 	argv = NULL;
 }
@@ -1308,26 +4449,32 @@ move_entries(const Arg *arg)
 static void
 open_entry(const Arg *arg)
 {
-	if (current_pane->entry_count < 1)
+	if (current_pane->current_index < 0 ||
+		current_pane->current_index >= current_pane->view_count)
 		return;
 
 	Entry *current_entry =
-		&current_pane->entries[current_pane->current_index];
+		pane_entry(current_pane, current_pane->current_index);
+	char fullpath[PATH_MAX];
+
+	get_fullpath(fullpath, current_pane->path, current_entry->name);
+
+	/* the loader reports unreadable directories, opendir could hang */
+	if (S_ISDIR(current_entry->mode)) {
+		set_pane_entries(current_pane, fullpath);
+		update_screen();
+		return;
+	}
 
-	switch (check_dir(current_entry->fullpath)) {
+	switch (check_dir(fullpath)) {
 	case 0: /* directory */
-		strncpy(current_pane->path, current_entry->fullpath, PATH_MAX);
-		remove_watch(current_pane);
-		set_pane_entries(current_pane);
-		add_watch(current_pane);
-		current_pane->current_index = 0;
-		current_pane->start_index = 0;
+		set_pane_entries(current_pane, fullpath);
 		update_screen();
 		break;
 	case 1: /* not a directory open file */
-		if (S_ISREG(current_entry->st.st_mode)) {
+		if (S_ISREG(current_entry->mode)) {
 			errno = 0; /* check_dir errno */
-			open_file(current_entry->fullpath);
+			open_file(fullpath);
 		}
 		break;
 	case -1: /* failed to open directory */
@@ -1362,9 +4509,7 @@ paste_entries(const Arg *arg)
 	spawn(&cmd);
 	print_status(color_normal, "Pasted...");
 
-	free(selected_entries);
-	selected_entries = NULL;
-	selected_count = 0;
+	free_selected_entries();
 	free(argv);
 	argv = NULL;
 }
@@ -1372,24 +4517,41 @@ paste_entries(const Arg *arg)
 static void
 quit(const Arg *arg)
 {
+	int i;
+
 	cancel_search_highlight();
+	stop_loader(&panes[Left]);
+	stop_loader(&panes[Right]);
+	for (i = Left; i <= Right; i++) {
+		cancel_loader(panes[i].statter);
+		if (panes[i].stat_next != NULL)
+			free_loader(panes[i].stat_next);
+	}
+	stop_prefetch();
+	save_snapshot();
 	cleanup_filesystem_events();
-	if (selected_entries != NULL)
-		free(selected_entries);
+	free_selected_entries();
 	if (term.buffer != NULL)
 		free(term.buffer);
-	if (panes[Left].entries != NULL)
-		free(panes[Left].entries);
-	if (panes[Right].entries != NULL)
-		free(panes[Right].entries);
+	free(term.cells);
+	free(term.shown);
+	free_lines();
+	free_entries(&panes[Left]);
+	free_entries(&panes[Right]);
+	cache_free();
 	disable_raw_mode();
+	if (report_startup && listings_usec >= 0)
+		fprintf(stderr, "first frame %ld us, listings %ld us\n",
+			first_frame_usec, listings_usec);
+	else if (report_startup)
+		fprintf(stderr, "first frame %ld us\n", first_frame_usec);
 	exit(EXIT_SUCCESS);
 }
 
 static void
 refresh(const Arg *arg)
 {
-	kill(main_pid, SIGWINCH);
+	termb_resize();
 }
 
 static void
@@ -1409,20 +4571,80 @@ select_entry(Entry *entry, int s)
 static void
 select_cur_entry(const Arg *arg)
 {
+	if (current_pane->current_index < 0 ||
+		current_pane->current_index >= current_pane->view_count)
+		return;
+
 	select_entry(
-		&current_pane->entries[current_pane->current_index], arg->i);
+		pane_entry(current_pane, current_pane->current_index), arg->i);
 	update_entry(current_pane, current_pane->current_index);
 }
 
 static void
 toggle_dotfiles(const Arg *arg)
 {
+	Pane *pane;
+	int i;
+
 	show_dotfiles ^= 1;
-	set_pane_entries(&panes[Left]);
-	set_pane_entries(&panes[Right]);
+	for (i = 0; i < 2; i++) {
+		pane = &panes[i];
+		/* windows are filtered while read, reread them */
+		if (pane->window.offsets != NULL || pane->loader != NULL) {
+			set_pane_entries(pane, target_path(pane));
+			continue;
+		}
+
+		/* hidden entries are in memory, only the view changes */
+		rebuild_view(pane);
+	}
+	update_screen();
+}
+
+static void
+sort_by(const Arg *arg)
+{
+	int i;
+
+	/* the same key again turns the order around */
+	if (sort_mode % SortKeys == arg->i)
+		sort_mode = (sort_mode + SortKeys) % SORT_MODES;
+	else
+		sort_mode = arg->i;
+
+	/* a cached order is only swapped in, windows stay unsorted */
+	for (i = 0; i < 2; i++)
+		if (panes[i].window.offsets == NULL)
+			rebuild_view(&panes[i]);
 	update_screen();
 }
 
+static void
+rebuild_view(Pane *pane)
+{
+	const char *cur = NULL;
+	int index;
+
+	/* the cursor stays on its entry and, if it can, on its row */
+	if (pane->current_index < pane->view_count)
+		cur = pane_entry(pane, pane->current_index)->name;
+	index = build_view(pane, cur);
+	if (index >= 0) {
+		pane->start_index += index - pane->current_index;
+		pane->current_index = index;
+	} else {
+		pane->current_index = MIN(
+			pane->current_index, MAX(pane->view_count - 1, 0));
+	}
+	/* no blank rows at the bottom while entries hide above the top */
+	pane->start_index = MIN(pane->start_index,
+		MAX(0, pane->view_count - (term.rows - 2)));
+	pane->start_index = MIN(pane->start_index, pane->current_index);
+	pane->start_index = MAX(
+		pane->start_index, pane->current_index - (term.rows - 3));
+	pane->start_index = MAX(pane->start_index, 0);
+}
+
 static void
 die(const char *fmt, ...)
 {
@@ -1456,106 +4678,409 @@ erealloc(void *p, size_t len)
 	return p;
 }
 
+static char *
+arena_strdup(Arena *arena, const char *str, size_t len)
+{
+	ArenaBlock *block;
+	size_t size;
+	char *p;
+
+	block = arena->head;
+	if (block == NULL || block->size - block->used < len + 1) {
+		size = MAX(ARENA_BLOCK, len + 1);
+		block = ecalloc(1, sizeof(ArenaBlock) + size);
+		block->size = size;
+		block->next = arena->head;
+		arena->head = block;
+	}
+
+	p = &block->data[block->used];
+	memcpy(p, str, len);
+	p[len] = '\0';
+	block->used += len + 1;
+	return p;
+}
+
+static void
+arena_move(Arena *dst, Arena *src)
+{
+	ArenaBlock *tail;
+
+	if (src->head == NULL)
+		return;
+	for (tail = src->head; tail->next != NULL; tail = tail->next)
+		;
+	tail->next = dst->head;
+	dst->head = src->head;
+	src->head = NULL;
+}
+
+static void
+arena_free(Arena *arena)
+{
+	ArenaBlock *block, *next;
+
+	for (block = arena->head; block != NULL; block = next) {
+		next = block->next;
+		free(block);
+	}
+	arena->head = NULL;
+}
+
+static void
+notify_watch(void)
+{
+	char c = 3;
+
+	/* a full pipe already has a wakeup queued */
+	if (write(load_pipe[1], &c, 1) < 0 && errno != EAGAIN)
+		log_to_file(__func__, __LINE__, "write: %s", strerror(errno));
+}
+
+static void
+set_watch_slow(Pane *pane)
+{
+	pthread_mutex_lock(&watcher.lock);
+	pane->watch.slow = pane->slow;
+	pthread_mutex_unlock(&watcher.lock);
+}
+
 #if defined(__linux__)
 static void *
 event_handler(void *arg)
 {
-	Pane *pane = (Pane *)arg;
+	struct epoll_event ev;
+	struct timespec start;
 	char buffer[EV_BUF_LEN];
-	int length, i;
-
-	log_to_file(__func__, __LINE__, "Event handler started for path: %s",
-		pane->path);
-
-	pane->watcher.fd = inotify_init();
-	if (pane->watcher.fd < 0) {
-		log_to_file(__func__, __LINE__,
-			"Error initializing inotify: %s", strerror(errno));
-		die("inotify_init:");
-		pthread_exit(NULL);
-	}
+	int length, n, w, window = -1, timeout = -1;
 
-	add_watch(pane);
+	log_to_file(__func__, __LINE__, "Event handler started");
 
 	while (1) {
-		length = read(pane->watcher.fd, buffer, EV_BUF_LEN);
-		if (length <= 0) {
-			log_to_file(__func__, __LINE__,
-				"Error reading inotify event: %s",
+		n = epoll_wait(watcher.epfd, &ev, 1, timeout);
+		if (n < 0 && errno != EINTR) {
+			log_to_file(__func__, __LINE__, "epoll_wait: %s",
 				strerror(errno));
-			die("read:");
 			break;
 		}
-
-		if (length < (int)sizeof(struct inotify_event)) {
-			log_to_file(__func__, __LINE__,
-				"Incomplete inotify event read");
-			die("read:");
+		if (n > 0 && ev.data.fd == watcher.stop[0])
 			break;
-		}
 
-		i = 0;
-		while (i < length) {
-			struct inotify_event *event =
-				(struct inotify_event *)&buffer[i];
-			if (event->mask) {
+		if (n > 0) {
+			length = read(watcher.fd, buffer, EV_BUF_LEN);
+			if (length < 0 && errno != EAGAIN) {
 				log_to_file(__func__, __LINE__,
-					"Inotify event detected: mask=%u, len=%u, name=%s",
-					event->mask, event->len,
-					event->len ? event->name : "");
-				usleep(50 * 1000); // 500 milliseconds
-				kill(main_pid, pane->watcher.signal);
+					"Error reading inotify event: %s",
+					strerror(errno));
+				break;
 			}
-			i += sizeof(struct inotify_event) + event->len;
+			/* the window starts with the first event of a burst */
+			w = length > 0 ? queue_events(buffer, length) : -1;
+			if (w >= 0 && window < 0)
+				clock_gettime(CLOCK_MONOTONIC, &start);
+			window = MAX(window, w);
+		}
+
+		/* one wakeup for the whole burst */
+		timeout = window < 0 ? -1 : time_left(&start, window);
+		if (timeout == 0) {
+			notify_watch();
+			window = timeout = -1;
 		}
 	}
-	close(pane->watcher.fd);
 	return NULL;
 }
 
-void
+static int
+queue_events(const char *buffer, int length)
+{
+	const struct inotify_event *ev;
+	int i, p, window = -1;
+
+	pthread_mutex_lock(&watcher.lock);
+	for (i = 0; i < length; i += sizeof(struct inotify_event) + ev->len) {
+		ev = (const struct inotify_event *)&buffer[i];
+		/* both panes share the watch of a directory they both show */
+		for (p = Left; p <= Right; p++) {
+			if (panes[p].watch.wd < 0)
+				continue;
+			if (ev->mask & IN_Q_OVERFLOW)
+				panes[p].watch.overflow = 1;
+			else if (ev->wd != panes[p].watch.wd || ev->len == 0)
+				continue;
+			else
+				queue_event(&panes[p].watch, ev);
+			window = MAX(window,
+				panes[p].watch.slow ? slow_watch_delay :
+						      watch_window);
+		}
+	}
+	pthread_mutex_unlock(&watcher.lock);
+	return window;
+}
+
+static void
+queue_event(Watch *w, const struct inotify_event *ev)
+{
+	const struct inotify_event *last;
+	size_t size;
+
+	/* a file being written sends an event for every write */
+	if (w->queue_len > 0 && (ev->mask & (IN_MODIFY | IN_ATTRIB))) {
+		last = (const struct inotify_event *)(w->queue + w->last);
+		if ((last->mask & (IN_MODIFY | IN_ATTRIB)) &&
+			strncmp(last->name, ev->name, ev->len) == 0)
+			return;
+	}
+
+	size = sizeof(struct inotify_event) + ev->len;
+	if (w->queue_len + size > WATCH_QUEUE_MAX) {
+		w->overflow = 1;
+		return;
+	}
+	if (w->queue_len + size > w->queue_cap) {
+		w->queue_cap = MAX(w->queue_cap * 2, EV_BUF_LEN);
+		w->queue = erealloc(w->queue, w->queue_cap);
+	}
+	memcpy(w->queue + w->queue_len, ev, size);
+	w->last = w->queue_len;
+	w->queue_len += size;
+}
+
+static int
+apply_window_events(Pane *pane, const char *queue, size_t len)
+{
+	const struct inotify_event *ev;
+	Entry *ent, old;
+	size_t off;
+	int i, changed = 0;
+
+	/*
+	 * where a new name lands in the directory is not known, the
+	 * window is read again later; the offsets stay usable, they
+	 * are only off by the names created or removed since
+	 */
+	for (off = 0; off < len; off += sizeof(*ev) + ev->len) {
+		ev = (const struct inotify_event *)(queue + off);
+		i = window_named(pane, ev->name);
+		if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+			pane->window.total = MAX(pane->window.total - 1, 0);
+			if (i >= 0)
+				request_reload(pane, ReloadWindow);
+			changed = 1; /* the count in the status line */
+		} else if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+			pane->window.total++;
+			request_reload(pane, ReloadWindow);
+			changed = 1;
+		} else if (i >= 0 && (ev->mask & (IN_ATTRIB | IN_MODIFY))) {
+			/* only the names shown are stat'ed again */
+			ent = &pane->entries[i];
+			old = *ent;
+			if (stat_entry(pane->dirfd, ent) < 0)
+				continue;
+			changed |= ent->size != old.size ||
+				ent->mtime != old.mtime ||
+				ent->mode != old.mode || ent->uid != old.uid ||
+				ent->gid != old.gid;
+		}
+	}
+	return changed;
+}
+
+static int
+window_named(Pane *pane, const char *name)
+{
+	int i;
+
+	/* a window is in directory order, never sorted */
+	for (i = 0; i < pane->entry_count; i++)
+		if (strncmp(pane->entries[i].name, name, NAME_MAX) == 0)
+			return i;
+	return -1;
+}
+
+static int
+apply_events(Pane *pane)
+{
+	Watch *w = &pane->watch;
+	const struct inotify_event *ev;
+	const char *cur_name = NULL;
+	Entry cur = { NULL }, *ent;
+	Arena scratch = { NULL };
+	char *queue;
+	size_t len, off;
+	int overflow, changed = 0, reread = 0, i, old_cur, new_cur;
+
+	/* a load in progress may see the changes, they are applied after */
+	if (pane->loader != NULL)
+		return 0;
+
+	pthread_mutex_lock(&watcher.lock);
+	queue = w->queue;
+	len = w->queue_len;
+	overflow = w->overflow;
+	w->queue = NULL;
+	w->queue_len = w->queue_cap = 0;
+	w->overflow = 0;
+	pthread_mutex_unlock(&watcher.lock);
+
+	if (len == 0 && overflow == 0) {
+		free(queue);
+		return 0;
+	}
+
+	/* a window takes the names it holds, the rest is counted */
+	if (overflow == 0 && pane->window.offsets != NULL &&
+		pane->dirfd >= 0) {
+		changed = apply_window_events(pane, queue, len);
+		free(queue);
+		return changed;
+	}
+
+	if (overflow || pane->window.offsets != NULL || pane->dirfd < 0) {
+		free(queue);
+		request_reload(pane, ReloadFull);
+		return 0;
+	}
+
+	old_cur = pane->current_index;
+	if (old_cur < pane->view_count) {
+		cur = *pane_entry(pane, old_cur);
+		cur_name = cur.name;
+	}
+
+	/* only a whole directory, read to the end, can take new names */
+	for (off = 0; off < len; off += sizeof(*ev) + ev->len) {
+		ev = (const struct inotify_event *)(queue + off);
+		if ((ev->mask & (IN_ATTRIB | IN_MODIFY)) && pane->partial &&
+			held_named(pane, ev->name, &scratch))
+			changed |= update_named(pane, ev->name, &scratch);
+		else if (pane->partial)
+			reread = 1;
+		else if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+			changed |= remove_named(pane, ev->name, &scratch);
+		else if (ev->mask &
+			(IN_CREATE | IN_MOVED_TO | IN_ATTRIB | IN_MODIFY))
+			changed |= update_named(pane, ev->name, &scratch);
+	}
+	arena_free(&scratch);
+	free(queue);
+	if (reread)
+		request_reload(pane, ReloadFull);
+
+	/* the view still holds, the status line shows the cursor entry */
+	if (changed == 0) {
+		if (pane != current_pane || cur_name == NULL)
+			return 0;
+		ent = pane_entry(pane, old_cur);
+		return ent->size != cur.size || ent->mtime != cur.mtime ||
+			ent->uid != cur.uid || ent->gid != cur.gid;
+	}
+
+	/* the cursor stays on its entry, or in its place if it went away */
+	if ((i = build_view(pane, cur_name)) >= 0)
+		new_cur = i;
+	else
+		new_cur = MAX(0, MIN(old_cur, pane->view_count - 1));
+	pane->current_index = new_cur;
+	pane->start_index = MIN(pane->start_index + new_cur - old_cur,
+		MAX(0, pane->view_count - (term.rows - 2)));
+	pane->start_index = MIN(pane->start_index, new_cur);
+	pane->start_index = MAX(pane->start_index, new_cur - (term.rows - 3));
+	pane->start_index = MAX(pane->start_index, 0);
+	return 1;
+}
+
+static void
 add_watch(Pane *pane)
 {
-	pane->watcher.descriptor = inotify_add_watch(
-		pane->watcher.fd, pane->path, IN_CREATE | IN_DELETE);
-	if (pane->watcher.descriptor < 0) {
+	int wd;
+
+	wd = inotify_add_watch(watcher.fd, pane->path,
+		IN_CREATE | IN_DELETE | IN_MOVE | IN_ATTRIB | IN_MODIFY);
+	if (wd < 0) {
 		log_to_file(__func__, __LINE__,
 			"Error adding inotify watch: %s", strerror(errno));
 		die("inotify_add_watch:");
 	}
+
+	pthread_mutex_lock(&watcher.lock);
+	pane->watch.wd = wd;
+	pane->watch.slow = pane->slow;
+	pthread_mutex_unlock(&watcher.lock);
 	log_to_file(__func__, __LINE__, "Added inotify watch for path: %s",
 		pane->path);
 }
 
-void
+static void
 remove_watch(Pane *pane)
 {
-	if (inotify_rm_watch(pane->watcher.fd, pane->watcher.descriptor) < 0)
-		die("inotify_rm_watch:");
+	Watch *w = &pane->watch;
+	Pane *other = &panes[pane == &panes[Left] ? Right : Left];
+
+	pthread_mutex_lock(&watcher.lock);
+	/* the other pane may still show the directory */
+	if (w->wd >= 0 && other->watch.wd != w->wd &&
+		inotify_rm_watch(watcher.fd, w->wd) < 0)
+		log_to_file(__func__, __LINE__, "inotify_rm_watch: %s",
+			strerror(errno));
+	w->wd = -1;
+	free(w->queue);
+	w->queue = NULL;
+	w->queue_len = w->queue_cap = 0;
+	w->overflow = 0;
+	pthread_mutex_unlock(&watcher.lock);
 }
 
-void
+static void
 cleanup_filesystem_events(void)
 {
-	remove_watch(&panes[Left]);
-	pthread_cancel(panes[Left].watcher.thread);
-	pthread_join(panes[Left].watcher.thread, NULL);
+	char c = 0;
 
-	remove_watch(&panes[Right]);
-	pthread_cancel(panes[Right].watcher.thread);
-	pthread_join(panes[Right].watcher.thread, NULL);
+	if (write(watcher.stop[1], &c, 1) < 0)
+		log_to_file(__func__, __LINE__, "write: %s", strerror(errno));
+	pthread_join(watcher.thread, NULL);
 
-	close(panes[Left].watcher.fd);
-	close(panes[Right].watcher.fd);
+	remove_watch(&panes[Left]);
+	remove_watch(&panes[Right]);
+	close(watcher.epfd);
+	close(watcher.fd);
+	close(watcher.stop[0]);
+	close(watcher.stop[1]);
 }
 
-void
+static void
 filesystem_event_init(void)
 {
-	pthread_create(
-		&panes[Left].watcher.thread, NULL, event_handler, &panes[Left]);
-	pthread_create(&panes[Right].watcher.thread, NULL, event_handler,
-		&panes[Right]);
+	struct epoll_event ev;
+	sigset_t oldset;
+
+	pthread_mutex_init(&watcher.lock, NULL);
+	watcher.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watcher.fd < 0)
+		die("inotify_init1:");
+	watcher.epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (watcher.epfd < 0)
+		die("epoll_create1:");
+	if (pipe(watcher.stop) < 0)
+		die("pipe:");
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = watcher.fd;
+	epoll_ctl(watcher.epfd, EPOLL_CTL_ADD, watcher.fd, &ev);
+	ev.data.fd = watcher.stop[0];
+	epoll_ctl(watcher.epfd, EPOLL_CTL_ADD, watcher.stop[0], &ev);
+
+	panes[Left].watch.wd = -1;
+	panes[Right].watch.wd = -1;
+	add_watch(&panes[Left]);
+	add_watch(&panes[Right]);
+
+	/* the watcher inherits the mask, signals go to the main thread */
+	block_signals(&oldset);
+	pthread_create(&watcher.thread, NULL, event_handler, NULL);
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
 }
 
 #elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || \
@@ -1564,94 +5089,102 @@ filesystem_event_init(void)
 static void *
 event_handler(void *arg)
 {
-	Pane *pane = (Pane *)arg;
-	struct kevent event;
-
-	log_to_file(__func__, __LINE__, "Event handler started for path: %s",
-		pane->path);
+	struct kevent events[8];
+	struct timespec start, wait, *timeout = NULL;
+	int n, i, p, window = -1, ms;
 
-	pane->watcher.kq = kqueue();
-	if (pane->watcher.kq == -1) {
-		log_to_file(__func__, __LINE__, "kqueue creation error: %s",
-			strerror(errno));
-		pthread_exit(NULL);
-	}
-
-	log_to_file(__func__, __LINE__, "Kqueue created with descriptor: %d",
-		pane->watcher.kq);
-
-	add_watch(pane);
+	log_to_file(__func__, __LINE__, "Event handler started");
 
 	while (1) {
-		log_to_file(__func__, __LINE__, "Waiting for events...");
-		int nev = kevent(pane->watcher.kq, NULL, 0, &event, 1,
-			NULL); // NULL timeout for indefinite wait
-		if (nev < 0) {
-			if (errno == EINTR) {
-				continue; // Retry if interrupted by signal
-			}
+		n = kevent(watcher.kq, NULL, 0, events, LEN(events), timeout);
+		if (n < 0 && errno != EINTR) {
 			log_to_file(__func__, __LINE__, "kevent wait error: %s",
 				strerror(errno));
-			pthread_exit(NULL);
-		} else if (nev > 0) {
-			log_to_file(__func__, __LINE__, "Event detected.");
-			usleep(500 * 1000); // 500 milliseconds
-			kill(main_pid, pane->watcher.signal);
-			if (event.fflags & NOTE_DELETE) {
-				log_to_file(__func__, __LINE__,
-					"File deleted: %s", pane->path);
-				break; // Exit the loop if the file is deleted
+			break;
+		}
+
+		pthread_mutex_lock(&watcher.lock);
+		for (i = 0; i < n; i++) {
+			if ((int)events[i].ident == watcher.stop[0])
+				break;
+			/* kqueue names no entry, the directory is read again */
+			for (p = Left; p <= Right; p++) {
+				if ((int)events[i].ident != panes[p].watch.fd)
+					continue;
+				panes[p].watch.changed = 1;
+				if (window < 0)
+					clock_gettime(CLOCK_MONOTONIC, &start);
+				window = MAX(window,
+					panes[p].watch.slow ? slow_watch_delay :
+							      watch_window);
 			}
-			log_to_file(__func__, __LINE__,
-				"Re-adding watch after event.");
-			add_watch(
-				pane); // Re-add the watch after handling the event
 		}
-	}
+		pthread_mutex_unlock(&watcher.lock);
+		if (n > 0 && i < n)
+			break;
 
-	log_to_file(__func__, __LINE__, "Closing file descriptor: %d",
-		pane->watcher.fd);
-	close(pane->watcher.fd);
-	close(pane->watcher.kq);
+		/* one wakeup for the whole burst */
+		ms = window < 0 ? -1 : time_left(&start, window);
+		if (ms == 0) {
+			notify_watch();
+			window = ms = -1;
+		}
+		wait.tv_sec = ms / 1000;
+		wait.tv_nsec = (ms % 1000) * 1000000L;
+		timeout = ms < 0 ? NULL : &wait;
+	}
 	return NULL;
 }
 
+static int
+apply_events(Pane *pane)
+{
+	int changed;
+
+	/* a load in progress may miss the change, it is read after */
+	if (pane->loader != NULL)
+		return 0;
+
+	pthread_mutex_lock(&watcher.lock);
+	changed = pane->watch.changed;
+	pane->watch.changed = 0;
+	pthread_mutex_unlock(&watcher.lock);
+
+	if (changed)
+		request_reload(pane, ReloadFull);
+	return 0;
+}
+
 static void
 add_watch(Pane *pane)
 {
-	if (pane->watcher.fd >= 0) {
-		log_to_file(__func__, __LINE__,
-			"Closing previous file descriptor: %d",
-			pane->watcher.fd);
-		close(pane->watcher.fd);
-	}
+	struct kevent change;
+	int fd;
 
-	pane->watcher.fd = open(pane->path, O_RDONLY);
-	if (pane->watcher.fd < 0) {
+	fd = open(pane->path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
 		log_to_file(
 			__func__, __LINE__, "open error: %s", strerror(errno));
 		return;
 	}
 
-	log_to_file(__func__, __LINE__,
-		"Opened file descriptor: %d for path: %s", pane->watcher.fd,
-		pane->path);
-
-	EV_SET(&pane->watcher.change, pane->watcher.fd, EVFILT_VNODE,
-		EV_ADD | EV_ENABLE | EV_ONESHOT,
+	/* no oneshot, the filter stays until the fd is closed */
+	EV_SET(&change, fd, EVFILT_VNODE, EV_ADD | EV_ENABLE | EV_CLEAR,
 		NOTE_DELETE | NOTE_WRITE | NOTE_ATTRIB | NOTE_RENAME |
 			NOTE_REVOKE,
-		0, (void *)pane->path);
-
-	if (kevent(pane->watcher.kq, &pane->watcher.change, 1, NULL, 0, NULL) ==
-		-1) {
+		0, 0);
+	if (kevent(watcher.kq, &change, 1, NULL, 0, NULL) == -1) {
 		log_to_file(__func__, __LINE__, "kevent register error: %s",
 			strerror(errno));
-		close(pane->watcher.fd);
-		pane->watcher.fd = -1;
+		close(fd);
 		return;
 	}
 
+	pthread_mutex_lock(&watcher.lock);
+	pane->watch.fd = fd;
+	pane->watch.slow = pane->slow;
+	pane->watch.changed = 0;
+	pthread_mutex_unlock(&watcher.lock);
 	log_to_file(__func__, __LINE__,
 		"Event registered successfully for path: %s", pane->path);
 }
@@ -1659,39 +5192,56 @@ add_watch(Pane *pane)
 static void
 remove_watch(Pane *pane)
 {
-	if (pane->watcher.fd >= 0) {
-		log_to_file(__func__, __LINE__,
-			"Removing watch for file descriptor: %d",
-			pane->watcher.fd);
-		if (close(pane->watcher.fd) < 0)
-			log_to_file(__func__, __LINE__,
-				"kevent remove error: %s", strerror(errno));
-		pane->watcher.fd = -1;
-	}
+	pthread_mutex_lock(&watcher.lock);
+	/* closing the fd drops its filter */
+	if (pane->watch.fd >= 0 && close(pane->watch.fd) < 0)
+		log_to_file(__func__, __LINE__, "close: %s", strerror(errno));
+	pane->watch.fd = -1;
+	pane->watch.changed = 0;
+	pthread_mutex_unlock(&watcher.lock);
 }
 
-void
+static void
 cleanup_filesystem_events(void)
 {
-	remove_watch(&panes[Left]);
-	pthread_cancel(panes[Left].watcher.thread);
-	//pthread_join(panes[Left].watcher.thread, NULL);
+	char c = 0;
 
-	remove_watch(&panes[Right]);
-	pthread_cancel(panes[Right].watcher.thread);
-	//pthread_join(panes[Right].watcher.thread, NULL);
+	if (write(watcher.stop[1], &c, 1) < 0)
+		log_to_file(__func__, __LINE__, "write: %s", strerror(errno));
+	pthread_join(watcher.thread, NULL);
 
-	close(panes[Left].watcher.kq);
-	close(panes[Right].watcher.kq);
+	remove_watch(&panes[Left]);
+	remove_watch(&panes[Right]);
+	close(watcher.kq);
+	close(watcher.stop[0]);
+	close(watcher.stop[1]);
 }
 
-void
+static void
 filesystem_event_init(void)
 {
-	pthread_create(
-		&panes[Left].watcher.thread, NULL, event_handler, &panes[Left]);
-	pthread_create(&panes[Right].watcher.thread, NULL, event_handler,
-		&panes[Right]);
+	struct kevent change;
+	sigset_t oldset;
+
+	pthread_mutex_init(&watcher.lock, NULL);
+	watcher.kq = kqueue();
+	if (watcher.kq < 0)
+		die("kqueue:");
+	if (pipe(watcher.stop) < 0)
+		die("pipe:");
+	EV_SET(&change, watcher.stop[0], EVFILT_READ, EV_ADD, 0, 0, 0);
+	if (kevent(watcher.kq, &change, 1, NULL, 0, NULL) == -1)
+		die("kevent:");
+
+	panes[Left].watch.fd = -1;
+	panes[Right].watch.fd = -1;
+	add_watch(&panes[Left]);
+	add_watch(&panes[Right]);
+
+	/* the watcher inherits the mask, signals go to the main thread */
+	block_signals(&oldset);
+	pthread_create(&watcher.thread, NULL, event_handler, NULL);
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
 }
 
 #endif
@@ -1699,7 +5249,7 @@ filesystem_event_init(void)
 static void
 visual_mode(const Arg *arg)
 {
-	if (current_pane->entry_count <= 0) {
+	if (current_pane->view_count <= 0) {
 		print_status(color_warn, "No entries to select.");
 		return;
 	}
@@ -1727,13 +5277,13 @@ normal_mode(const Arg *arg)
 void
 select_all(const Arg *arg)
 {
-	if (current_pane->entry_count <= 0) {
+	if (current_pane->view_count <= 0) {
 		print_status(color_warn, "No entries to select.");
 		return;
 	}
 
-	for (int i = 0; i < current_pane->entry_count; i++) {
-		select_entry(&current_pane->entries[i], arg->i);
+	for (int i = 0; i < current_pane->view_count; i++) {
+		select_entry(pane_entry(current_pane, i), arg->i);
 	}
 
 	update_screen();
@@ -1769,6 +5319,8 @@ start_search(const Arg *arg)
 static void
 update_search_highlight(const char *search_term)
 {
+	Entry *ent;
+
 	if (current_pane->matched_indices != NULL) {
 		free(current_pane->matched_indices);
 		current_pane->matched_indices = NULL;
@@ -1776,19 +5328,15 @@ update_search_highlight(const char *search_term)
 	}
 
 	current_pane->matched_indices =
-		(int *)ecalloc(current_pane->entry_count, sizeof(int));
+		(int *)ecalloc(MAX(current_pane->entry_count, 1), sizeof(int));
 
+	/* hidden entries too, they match once shown */
 	for (int i = 0; i < current_pane->entry_count; i++) {
-		if (strcasestr(current_pane->entries[i].name, search_term) !=
-			NULL) {
-			current_pane->entries[i].matched = 1;
-			current_pane->matched_indices
-				[current_pane->matched_count++] = i;
-		} else {
-			current_pane->entries[i].matched = 0;
-		}
-		set_entry_color(&current_pane->entries[i]);
+		ent = &current_pane->entries[i];
+		ent->matched = strcasestr(ent->name, search_term) != NULL;
+		set_entry_color(ent);
 	}
+	build_view(current_pane, NULL); /* collects the matches shown */
 	update_screen();
 }
 
@@ -1798,8 +5346,8 @@ cancel_search_highlight(void)
 	if (current_pane->matched_indices == NULL)
 		return;
 
-	for (int i = 0; i < current_pane->entry_count; i++) {
-		set_entry_color(&current_pane->entries[i]);
+	for (int i = 0; i < current_pane->view_count; i++) {
+		set_entry_color(pane_entry(current_pane, i));
 	}
 	if (current_pane->matched_indices != NULL) {
 		free(current_pane->matched_indices);
@@ -1848,12 +5396,20 @@ int
 main(int argc, const char *argv[])
 {
 	char c;
+	struct pollfd fds[4];
+	int ready, timeout, wait;
 
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
 	if (remove("/tmp/sfm.log") != 0) {
 		fprintf(stderr, "Error removing log file: %s\n",
 			strerror(errno));
 	}
 
+	if (argc == 2 && strcmp("-t", argv[1]) == 0) {
+		report_startup = 1;
+		argc = 1;
+	}
+
 	if (argc == 1) {
 #if defined(__OpenBSD__)
 		if (pledge("cpath exec getpw proc rpath stdio tmppath tty wpath",
@@ -1861,6 +5417,11 @@ main(int argc, const char *argv[])
 			die("pledge");
 #endif /* __OpenBSD__ */
 		mode = NormalMode;
+		setvbuf(stdin, NULL, _IONBF, 0); /* poll sees every key */
+		setlocale(LC_CTYPE, ""); /* for the widths of names */
+		if (name_order == NameLocale)
+			setlocale(LC_COLLATE, "");
+		errno = 0; /* setlocale may leave ENOENT from its lookups */
 		init_term();
 		enable_raw_mode();
 		get_env();
@@ -1868,18 +5429,76 @@ main(int argc, const char *argv[])
 		start_signal();
 		log_to_file(__func__, __LINE__, "start");
 
-		termb_append("\033[2J", 4);
 		update_screen();
+		flush_cells();
+		first_frame_usec = log_startup("first frame");
+		start_stats();
 
 		filesystem_event_init();
+
+		/*
+		 * keys, directory batches and changes, cached directory
+		 * changes and signals, nothing is drawn in a signal handler
+		 */
+		fds[0].fd = STDIN_FILENO;
+		fds[0].events = POLLIN;
+		fds[1].fd = load_pipe[0];
+		fds[1].events = POLLIN;
+		fds[2].fd = cache_fd; /* ignored while negative */
+		fds[2].events = POLLIN;
+		fds[3].fd = signal_pipe[0];
+		fds[3].events = POLLIN;
+		clock_gettime(CLOCK_MONOTONIC, &idle_since);
 		while (1) {
-			c = getchar();
-			handle_keypress(c);
+			/* the first due of a resize and the idle prefetch */
+			timeout = prefetch_wait();
+			wait = resize_pending
+				? time_left(&resize_time, RESIZE_DELAY)
+				: -1;
+			if (timeout < 0 || (wait >= 0 && wait < timeout))
+				timeout = wait;
+			wait = reload_wait();
+			if (timeout < 0 || (wait >= 0 && wait < timeout))
+				timeout = wait;
+			if ((ready = poll(fds, 4, timeout)) < 0) {
+				if (errno != EINTR)
+					die("poll:");
+				errno = 0;
+				continue;
+			}
+			if (ready > 0)
+				clock_gettime(CLOCK_MONOTONIC, &idle_since);
+			if (fds[3].revents & POLLIN)
+				handle_signals();
+			if (fds[1].revents & POLLIN)
+				handle_loaded();
+			if (fds[2].revents & POLLIN)
+				handle_cache_events();
+			if (fds[0].revents & POLLIN) {
+				stop_prefetch(); /* keys get the disk first */
+				c = getchar();
+				if (c != XK_ESC || read_sequence() == 0)
+					handle_keypress(c);
+			}
+			if (resize_pending &&
+				time_left(&resize_time, RESIZE_DELAY) == 0)
+				termb_resize();
+			if (prefetch_wait() == 0)
+				start_prefetch();
+			run_reloads();
+
+			/* one frame for everything handled above */
+			if (redraw_pending) {
+				errno = redraw_errno;
+				update_screen();
+			}
+			flush_cells();
+			start_stats(); /* for the rows just drawn */
 		}
 	} else if (argc == 2 && strncmp("-v", argv[1], 2) == 0) {
 		die("sfm-" VERSION);
 	} else {
-		die("usage: sfm [-v]");
+		die("usage: sfm [-tv]");
 	}
 
 	return 0;
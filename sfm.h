@@ -30,8 +30,15 @@
 #define XK_ESC       0x1B
 #define XK_SPACE     0x20
 
+#define LINES_PER_ROW 4  /* line cache slots for each screen row */
+#define SEQUENCE_WAIT 20 /* ms for the rest of an escape sequence */
+#define SYNC_BEGIN    "\x1b[?2026h"
+#define SYNC_END      "\x1b[?2026l"
+
 #define UINT8_LEN  3
 #define UINT16_LEN 5
+#define UINT32_LEN 10
+#define UINT64_LEN 20
 
 #define GROUP_MAX      32
 #define USER_MAX       32
@@ -40,6 +47,28 @@
 #define PROMPT_MAX     64
 #define PERMISSION_MAX 10
 #define FSIZE_MAX      32
+#define FSTYPE_MAX     16
+#define ARENA_BLOCK    (64 * 1024)
+
+#define STAT_CHUNK       64 /* entries claimed per worker turn */
+#define STAT_THREADS_MAX 64
+#define STAT_QUEUE_MAX   512 /* drawn rows waiting for a stat */
+#define URING_DEPTH      256 /* statx requests in flight */
+#define LOAD_BATCH_MAX   (64 * 1024)
+#define SORT_INSERTION   16 /* runs short enough for insertion sort */
+#define SORT_MODES       8  /* every one of SortKeys both ways */
+#define WINDOW_STRIDE    256  /* entries between directory offsets */
+#define WINDOW_OFFSETS   4096 /* offsets kept, the stride grows past it */
+#define SNAPSHOT_MAGIC   0x32534653 /* "SFS2" */
+#define SNAPSHOT_FILE    "sfm.snapshot"
+#define RESIZE_DELAY     30 /* ms, a window drag is drawn once it stops */
+#define WATCH_QUEUE_MAX  (1024 * 1024) /* event bytes, a reload past it */
+
+#if defined(STATX_TYPE)
+#define STATX_FIELDS \
+	(STATX_TYPE | STATX_MODE | STATX_UID | STATX_GID | STATX_SIZE | \
+		STATX_MTIME)
+#endif
 
 #define MAX(A, B)        ((A) > (B) ? (A) : (B))
 #define MIN(A, B)        ((A) < (B) ? (A) : (B))
@@ -51,6 +80,20 @@
 		category, LEN(category), command, LEN(command), (wait) \
 	}
 
+typedef struct {
+	uint8_t fg;
+	uint8_t bg;
+	uint8_t attr;
+} ColorPair;
+
+typedef struct {
+	char glyph[8]; /* utf-8, with any combining marks */
+	uint8_t len;   /* 0 on the right half of a wide glyph */
+	uint8_t width;
+	uint8_t plain; /* terminal default colors */
+	ColorPair color;
+} Cell;
+
 typedef struct {
 	struct termios orig;
 	struct termios newterm;
@@ -60,56 +103,283 @@ typedef struct {
 	unsigned long buffer_size;
 	unsigned long buffer_left;
 	ssize_t buffer_index;
+	Cell *cells; /* the next frame */
+	Cell *shown; /* what the terminal shows */
+	size_t cells_len;
+	int clear;   /* shown is unknown, start from an erased screen */
+	int cur_row; /* of the terminal cursor, -1 when unknown */
+	int cur_col;
+	Cell pen;    /* the sgr state of the terminal */
+	int park_row; /* where the cursor rests after a frame */
+	int park_col;
+	int dirty;    /* cells changed since the last frame */
+	int margins;  /* left and right ones work, DECLRMM */
 } Terminal;
 
 typedef struct {
-	uint8_t fg;
-	uint8_t bg;
-	uint8_t attr;
-} ColorPair;
+	char *name; /* of the entry drawn, only compared */
+	ColorPair color;
+	Cell *cells; /* term.cols / 2 of them */
+} Line;
+
+typedef struct ArenaBlock ArenaBlock;
+struct ArenaBlock {
+	ArenaBlock *next;
+	size_t used;
+	size_t size;
+	char data[];
+};
+
+typedef struct {
+	ArenaBlock *head;
+} Arena;
 
 typedef struct {
-	char fullpath[PATH_MAX];
-	char name[NAME_MAX];
-	struct stat st;
-	int selected;
-	int matched;
+	char *name; /* owned by the pane arena */
+	char *key;  /* collation key next to it, NULL for byte order */
+	uint32_t key_len;
+	off_t size;
+	time_t mtime;
+	uid_t uid;
+	gid_t gid;
+	mode_t mode;
+	uint8_t selected;
+	uint8_t matched;
+	uint8_t stated; /* mode holds only the d_type bits until set */
 	ColorPair color;
+	uint16_t line; /* slot in the line cache plus one, 0 for none */
 } Entry;
 
+typedef struct {
+	Entry *entries;
+	int count;
+	int next; /* first unclaimed entry */
+	int dirfd;
+	int lazy; /* skip entries with a d_type */
+	pthread_mutex_t lock;
+} StatJob;
+
+typedef struct {
+	uint64_t key; /* size, time or first name bytes, big endian */
+	uint32_t type;
+	uint32_t index; /* into the entries */
+} SortKey;
+
+typedef struct {
+	SortKey *keys;
+	SortKey *tmp;
+	int count;
+	int depth; /* halvings still handed to another thread */
+	const Entry *entries;
+	int mode;
+} SortJob;
+
+#if defined(HAVE_IO_URING)
+typedef struct {
+	int fd;
+	unsigned depth;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ring;
+	void *cq_ring;
+	size_t sq_len;
+	size_t cq_len;
+	size_t sqes_len;
+} Uring;
+#endif
+
 #if defined(__linux__)
 typedef struct {
-	char directory[PATH_MAX];
+	uint32_t magic;
+	const char *name;
+} FsMagic;
+
+typedef struct {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+} Dirent64;
+
+typedef struct {
+	int wd;   /* inotify watch, -1 for none */
+	int slow; /* events gather for slow_watch_delay */
+	char *queue; /* inotify events the main thread has not applied */
+	size_t queue_len;
+	size_t queue_cap;
+	size_t last; /* offset of the last queued event */
+	int overflow; /* events were lost, only a reload is right */
+} Watch;
+
+typedef struct {
 	pthread_t thread;
-	int fd;
-	int signal;
-	int descriptor;
+	int fd; /* inotify, one for both panes */
+	int epfd;
+	int stop[2]; /* ends the thread */
+	pthread_mutex_t lock; /* the Watch of both panes */
 } Watcher;
 #elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || \
 	defined(__APPLE__) || defined(__DragonFly__)
 typedef struct {
-	char directory[PATH_MAX];
+	int fd; /* the directory, -1 for none */
+	int slow;
+	int changed;
+} Watch;
+
+typedef struct {
 	pthread_t thread;
-	int fd;
-	int signal;
-	struct kevent change;
-	int kq;
+	int kq; /* vnode filters of both panes */
+	int stop[2];
+	pthread_mutex_t lock; /* the Watch of both panes */
 } Watcher;
 #endif
 
+typedef struct {
+	int64_t *offsets; /* directory offset of every stride-th entry */
+	int count;
+	int stride;
+	int total; /* entries in the directory */
+	int first; /* index of pane->entries[0] in the directory */
+	int dotfiles;
+} Window;
+
+typedef struct {
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	struct timespec ctime;
+} DirStamp;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t count;        /* listings */
+	uint32_t listing_size; /* layout of this build */
+	uint32_t entry_size;
+	uint32_t name_order; /* the listings are sorted by it */
+	uint32_t pad;
+} SnapHeader;
+
 typedef struct {
 	char path[PATH_MAX];
-	Entry *entries;
+	DirStamp stamp;
+	char fstype[FSTYPE_MAX];
+	int32_t slow;
+	int32_t entry_count;
+	int32_t cursor; /* entry under the cursor, -1 for none */
+	int32_t row;
+	uint64_t names_size; /* names after the entries, 8 byte padded */
+} SnapListing;
+
+typedef struct {
+	int64_t size;
+	int64_t mtime;
+	uint32_t uid;
+	uint32_t gid;
+	uint32_t mode;
+	uint32_t name; /* offset into the names */
+	uint32_t stated;
+	uint32_t pad;
+} SnapEntry;
+
+typedef struct Pane Pane;
+
+typedef struct {
+	Pane *pane; /* NULL for a prefetch */
+	char path[PATH_MAX];
+	pthread_t thread;
+	pthread_mutex_t lock; /* cancel, pending, counted, done, error, dirfd */
+	int cancel;  /* a newer load replaced this one */
+	int swapped; /* main thread only, the pane shows this listing */
+	int done;
+	int error;
+	int dirfd;
+	int counted;  /* entries read so far */
+	int windowed; /* past window_min, only counting */
+	int slow;     /* network or fuse mount, or slow stat */
+	int prefetch; /* no pane, the listing goes to the cache */
+	char fstype[FSTYPE_MAX];
+	DirStamp stamp; /* the directory before it was read */
+	int validate;    /* stop before reading if stamp is still expect */
+	int unchanged;
+	DirStamp expect;
+	Window window;
+	int refill;   /* reads one window of the pane, see load_window */
+	int64_t seek; /* directory offset the window is read from */
+	int skip;     /* entries between seek and the window */
+	int size;     /* entries in the window */
+	int restat;   /* stats the pending entries, see queue_stat */
+	int all;      /* every unstated entry of the pane, see stat_all */
+	char keep[NAME_MAX + 1]; /* cursor entry of a reload, "" for none */
+	int keep_row;            /* and its row on the screen */
+	int keep_index;          /* and its place in the directory */
+	int kept;                /* found, the cursor follows it from now */
+	Arena names;         /* loader thread only */
+	Arena pending_names; /* names of the pending entries */
+	Entry *pending;      /* not yet merged into the pane */
+	int *pending_order;  /* pending in sort order */
+	int pending_count;
+	int pending_cap;
+	Entry *batch; /* loader thread only */
+	int *batch_order;
+	int batch_count;
+	int batch_cap;
+	int batch_target;
+} Loader;
+
+struct Pane {
+	char path[PATH_MAX];
+	Entry *entries; /* hidden ones too, in load order */
+	int *orders[SORT_MODES]; /* entries in each sort order, or NULL */
 	int entry_count;
+	int *view; /* entries shown, all indexes below are into it */
+	int view_count;
+	Arena names;
+	int dirfd;
+	Loader *loader; /* NULL when idle */
+	Loader *statter;   /* stats rows drawn before they were stat'ed */
+	Loader *stat_next; /* the rows waiting for it */
+	Window window; /* offsets is NULL unless the pane holds a window */
+	int slow;      /* stat lazily, reload less often */
+	char fstype[FSTYPE_MAX];
+	DirStamp stamp;
+	int partial;  /* not read to the end, never cached */
+	int validate; /* listing from the snapshot, still unchecked */
+	int reload;   /* a reread asked for by events, see run_reloads */
+	struct timespec reload_time; /* of the last one */
 	int start_index;
 	int current_index;
-	Watcher watcher;
+	Watch watch; /* under watcher.lock */
 	char search_term[NAME_MAX];
 	int *matched_indices;
 	int matched_count;
 	int current_match;
 	int offset;
-} Pane;
+};
+
+typedef struct {
+	char path[PATH_MAX];
+	DirStamp stamp;
+	Entry *entries;
+	int *orders[SORT_MODES];
+	int entry_count;
+	Arena names;
+	int dirfd;
+	int slow;
+	char fstype[FSTYPE_MAX];
+	const char *cursor; /* name of the entry under the cursor */
+	int row;            /* its screen row */
+	int watch;          /* inotify descriptor, -1 if checked by stat */
+	int stale;
+	unsigned long used; /* last use, 0 for a free slot */
+} Listing;
 
 typedef union {
 	int i;
@@ -143,6 +413,9 @@ enum { Wait = 0, DontWait = WNOHANG }; /* spawn forks */
 enum { NormalMode, VisualMode, SearchMode };
 enum { DontSelect, Select, InvertSelection };
 enum { NextMatch, PrevMatch }; /* search */
+enum { SortName, SortSize, SortTime, SortExt, SortKeys }; /* sort modes */
+enum { NameBytes, NameNatural, NameLocale }; /* name orders */
+enum { ReloadNone, ReloadWindow, ReloadFull }; /* pane rereads */
 
 /* function declarations */
 static void log_to_file(const char *, int, const char *, ...); /* DELETE */
@@ -152,19 +425,128 @@ static void enable_raw_mode(void);
 static void get_term_size(void);
 static void get_env(void);
 static int start_signal(void);
+static void block_signals(sigset_t *);
 static void sighandler(int);
+static void handle_signals(void);
+static void schedule_redraw(void);
+static int prefetch_wait(void);
+static int time_left(const struct timespec *, int);
 static void set_panes(void);
-static void set_pane_entries(Pane *);
-static int should_skip_entry(const struct dirent *);
+static void set_pane_entries(Pane *, const char *);
+static const char *target_path(Pane *);
+static Loader *new_loader(Pane *, const char *);
+static void stop_loader(Pane *);
+static void cancel_loader(Loader *);
+static void free_loader(Loader *);
+static void start_prefetch(void);
+static void stop_prefetch(void);
+static void merge_prefetch(void);
+static int load_cancelled(Loader *);
+static void *load_worker(void *);
+static void finish_load(Loader *, int);
+static void get_fs_type(int, char *, size_t);
+static int is_slow_fs(const char *);
+static void notify_loaded(Loader *);
+static int read_entries(Loader *, int);
+static int over_budget(Loader *);
+static void add_entry(Loader *, int, const char *, unsigned char);
+static void flush_batch(Loader *, int);
+#if defined(__linux__)
+static void count_entry(Loader *, int64_t);
+static void add_offset(Window *, int64_t);
+static void load_window(Pane *);
+static void *window_worker(void *);
+static void merge_window(Pane *);
+#endif
+static void fit_window(Pane *);
+static int pane_total(Pane *);
+static void handle_loaded(void);
+static void merge_loaded(Pane *);
+static void request_reload(Pane *, int);
+static int reload_wait(void);
+static void run_reloads(void);
+static int build_view(Pane *, const char *);
+static Entry *pane_entry(Pane *, int);
+static int find_order(const Entry *, const int *, int, const Entry *, int);
+static int order_index(const Entry *, const int *, int, int, int);
+static void link_entry(Pane *, int, int);
+static void unlink_entry(Pane *, int, int);
+static void remove_entry(Pane *, int);
+static int find_named(Pane *, Entry *);
+static int update_named(Pane *, const char *, Arena *);
+static int held_named(Pane *, const char *, Arena *);
+static int entry_named(Pane *, const char *, Arena *);
+static int remove_named(Pane *, const char *, Arena *);
+static void swap_listing(Pane *, Loader *);
+static void set_stamp(DirStamp *, const struct stat *);
+static int same_stamp(const DirStamp *, const DirStamp *);
+static void handle_cache_events(void);
+static Listing *cache_lookup(const char *);
+static void cache_store(Pane *);
+static void cache_restore(Pane *, Listing *);
+static void cache_unwatch(Listing *);
+static void cache_drop(Listing *);
+static void cache_free(void);
+static int snapshot_path(char *, size_t);
+static void save_snapshot(void);
+static void write_listing(FILE *, Pane *);
+static void load_snapshot(void);
+static void read_listing(Pane *, const SnapListing *);
+static long log_startup(const char *);
+static int *pane_order(Pane *);
+static void free_orders(int **);
+static void sort_order(const Entry *, int *, int, int);
+static void *sort_worker(void *);
+static void sort_keys(SortKey *, SortKey *, int, int, const Entry *, int);
+static int key_compare(
+	const SortKey *, const SortKey *, const Entry *, int);
+static void merge_order(
+	const Entry *, int *, int, const int *, int, int, int);
+static void merge_orders(Pane *, const int *, int, int);
+static uint64_t name_prefix(const char *);
+static void set_name_key(Arena *, Entry *);
+static size_t natural_key(const char *, char *);
+static int name_compare(const Entry *, const Entry *);
+static const char *entry_ext(const Entry *);
+static mode_t dtype_to_mode(unsigned char);
+static void stat_entries(Entry *, int, int, int);
+static void *stat_worker(void *);
+static int stat_entry(int, Entry *);
+static void queue_stat(Pane *, Entry *);
+static int stat_queued(const Loader *, const char *);
+static void stat_all(Pane *);
+static void start_stats(void);
+static void *restat_worker(void *);
+static int merge_stats(Pane *);
+#if defined(STATX_TYPE)
+static int statx_flags(void);
+static void fill_entry_statx(Entry *, const struct statx *);
+#endif
+#if defined(HAVE_IO_URING)
+static int uring_init(Uring *, unsigned);
+static void uring_free(Uring *);
+static void uring_key_init(void);
+static void uring_release(void *);
+static Uring *uring_get(void);
+static int uring_stat_entries(Entry *, int, int, int);
+#endif
+static int should_skip_entry(const char *, int);
+static void free_entries(Pane *);
 static void get_fullpath(char *, const char *, const char *);
+static char *get_entry_path(Pane *, Entry *);
 static int get_selected_paths(Pane *, char **);
-static int entry_compare(const void *const, const void *const);
+static void free_selected_entries(void);
+static int entry_compare(const Entry *, const Entry *, int);
 static void update_screen(void);
 static void disable_raw_mode(void);
 static void append_entries(Pane *);
+static void put_entry(Pane *, int);
+static Cell *entry_line(Entry *, ColorPair);
+static int read_sequence(void);
 static void handle_keypress(char);
 static void grabkeys(uint32_t, Key *, size_t);
 static void print_status(ColorPair, const char *, ...);
+static void put_status(ColorPair, const char *);
 static void display_entry_details(void);
 static void set_entry_color(Entry *);
 static void get_entry_datetime(char *, time_t);
@@ -180,11 +562,38 @@ static int check_rule(const char *);
 static void spawn(Command *);
 static int execute_command(Command *);
 static void termb_append(const char *, size_t);
+static char *termb_room(size_t);
+static void termb_csi(int, int, char);
+static char *encode_uint(char *, unsigned long, int);
+static char *encode_str(char *, const char *, ...);
 static void termb_write(void);
 static void write_entries_name(void);
+static void resize_cells(void);
+static void free_lines(void);
+static int decode_glyph(const char *, Cell *);
+static int put_text(int, int, int, const char *, ColorPair);
+static int layout_text(Cell *, int, const char *, ColorPair);
+static void put_line(int, int, int, const char *, ColorPair);
+static void fill_cells(int, int, int, const Cell *);
+static int num_len(int);
+static int same_pen(const Cell *, const Cell *);
+static void move_to(int, int);
+static void set_pen(const Cell *);
+static void termb_begin(void);
+static void scroll_cells(int, int, int, int, int);
+static void flush_cells(void);
 
+static void notify_watch(void);
+static void set_watch_slow(Pane *);
 static void filesystem_event_init(void);
 static void *event_handler(void *);
+#if defined(__linux__)
+static int queue_events(const char *, int);
+static void queue_event(Watch *, const struct inotify_event *);
+static int apply_window_events(Pane *, const char *, size_t);
+static int window_named(Pane *, const char *);
+#endif
+static int apply_events(Pane *);
 static void add_watch(Pane *);
 static void remove_watch(Pane *);
 static void cleanup_filesystem_events(void);
@@ -211,9 +620,14 @@ static void select_entry(Entry *, int);
 
 static void refresh(const Arg *);
 static void toggle_dotfiles(const Arg *);
+static void sort_by(const Arg *);
+static void rebuild_view(Pane *);
 static void die(const char *, ...);
 static void *ecalloc(size_t, size_t);
 static void *erealloc(void *, size_t);
+static char *arena_strdup(Arena *, const char *, size_t);
+static void arena_move(Arena *, Arena *);
+static void arena_free(Arena *);
 static void quit(const Arg *);
 
 static void visual_mode(const Arg *);